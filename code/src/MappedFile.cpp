@@ -0,0 +1,105 @@
+#include "MappedFile.h"
+#include <ios>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+MappedFile::MappedFile()
+{
+	data = NULL;
+	size = 0;
+}
+
+MappedFile::MappedFile(const char *filePath)
+{
+	data = NULL;
+	size = 0;
+
+	int fileDescriptor = open(filePath, O_RDONLY);
+	if (fileDescriptor < 0)
+	{
+		throw ios_base::failure("Cannot open input file for reading");
+	}
+
+	struct stat fileStatus;
+	if (fstat(fileDescriptor, &fileStatus) != 0)
+	{
+		close(fileDescriptor);
+		throw ios_base::failure("Cannot read the size of the input file");
+	}
+
+	// mmap CANNOT MAP ZERO BYTES, SO AN EMPTY FILE IS LEFT WITHOUT DATA
+	if (fileStatus.st_size > 0)
+	{
+		void *mapping = mmap(NULL, fileStatus.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (mapping == MAP_FAILED)
+		{
+			close(fileDescriptor);
+			throw ios_base::failure("Cannot map the input file into memory");
+		}
+
+		// THE FILE IS READ FROM START TO END, SO THE KERNEL CAN READ AHEAD AGGRESSIVELY
+		madvise(mapping, fileStatus.st_size, MADV_SEQUENTIAL);
+		data = (const char *)mapping;
+		size = fileStatus.st_size;
+	}
+
+	// THE MAPPING STAYS VALID AFTER THE FILE IS CLOSED
+	close(fileDescriptor);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+	{
+		munmap((void *)data, size);
+	}
+}
+
+MappedFile::MappedFile(MappedFile &&other)
+{
+	data = other.data;
+	size = other.size;
+	other.data = NULL;
+	other.size = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other)
+{
+	if (this != &other)
+	{
+		if (data)
+		{
+			munmap((void *)data, size);
+		}
+		data = other.data;
+		size = other.size;
+		other.data = NULL;
+		other.size = 0;
+	}
+	return *this;
+}
+
+const char *MappedFile::getData() const
+{
+	return data;
+}
+
+size_t MappedFile::getSize() const
+{
+	return size;
+}
+
+void MappedFile::release(const char *begin, const char *end)
+{
+	// ONLY THE PAGES THAT ARE WHOLLY INSIDE THE RANGE ARE RELEASED, SO THE BYTES AROUND IT ARE NOT AFFECTED
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t first = ((begin - data) + pageSize - 1) / pageSize * pageSize;
+	size_t last = (end - data) / pageSize * pageSize;
+	if (first < last)
+	{
+		madvise((void *)(data + first), last - first, MADV_DONTNEED);
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <stddef.h>
+
+/**
+ * A file mapped read-only into memory with mmap, so that it can be read as one
+ * array of bytes without copying it into buffers. The mapping is released when
+ * the object is destroyed. An empty file has a size of zero and no data.
+ *
+ * Throws ios_base::failure if the file cannot be opened or mapped.
+ */
+class MappedFile
+{
+private:
+	const char *data;
+	size_t size;
+
+public:
+	/**
+	 * Creates an object that holds no file, for a mapping to be moved into later.
+	 */
+	MappedFile();
+	MappedFile(const char *filePath);
+	~MappedFile();
+
+	// A MAPPING HAS ONE OWNER: IT CAN BE MOVED BUT NOT COPIED
+	MappedFile(MappedFile &&other);
+	MappedFile &operator=(MappedFile &&other);
+	MappedFile(const MappedFile &other) = delete;
+	MappedFile &operator=(const MappedFile &other) = delete;
+
+	const char *getData() const;
+	size_t getSize() const;
+
+	/**
+	 * Gives back the memory of the whole pages between begin and end, which
+	 * must be inside the mapping and will not be read again. Reading them
+	 * anyway reads the file again.
+	 */
+	void release(const char *begin, const char *end);
+};
+
+#endif /* MAPPEDFILE_H_ */
@@ -0,0 +1,210 @@
+#include "MatrixBinaryFormat.h"
+#include <stdexcept>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+using namespace std;
+
+// ODD 64-BIT CONSTANTS USED TO MIX THE WORDS INTO THE CHECKSUM (THE PRIMES OF xxHash64)
+const unsigned long long CHECKSUM_PRIME1 = 0x9E3779B185EBCA87ULL;
+const unsigned long long CHECKSUM_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const unsigned long long CHECKSUM_PRIME3 = 0x165667B19E3779F9ULL;
+const unsigned long long CHECKSUM_SEED = 0xCBF29CE484222325ULL;
+
+// THROWING AN ERROR ABOUT A BINARY MATRIX FILE
+void binaryFormatError(const char *fileName, const char *problem)
+{
+	char message[2048];
+	snprintf(message, sizeof(message), "Invalid binary matrix file %s: %s", fileName, problem);
+	throw invalid_argument(message);
+}
+
+bool isBinaryMatrix(const char *data, size_t size)
+{
+	return size >= sizeof(BINARY_MATRIX_MAGIC) && memcmp(data, BINARY_MATRIX_MAGIC, sizeof(BINARY_MATRIX_MAGIC)) == 0;
+}
+
+size_t binaryMatrixSize(long long rows, long long nnz, size_t headerSize)
+{
+	return headerSize + (rows + 1) * sizeof(long long) + 2 * nnz * sizeof(int);
+}
+
+BinaryMatrixHeader readBinaryMatrixHeader(const char *data, size_t size, const char *fileName)
+{
+	BinaryMatrixHeader header;
+	if (!isBinaryMatrix(data, size) || size < sizeof(header))
+	{
+		binaryFormatError(fileName, "the header is missing");
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (header.version != BINARY_MATRIX_VERSION)
+	{
+		binaryFormatError(fileName, "unsupported version or byte order");
+	}
+	if (header.headerSize < sizeof(header) || header.headerSize % 8 != 0 || header.headerSize > size)
+	{
+		binaryFormatError(fileName, "the header size is invalid");
+	}
+	if (header.rows <= 0 || header.rows > INT_MAX || header.cols <= 0 || header.cols > INT_MAX || header.nnz < 0)
+	{
+		binaryFormatError(fileName, "the dimensions in the header are invalid");
+	}
+
+	// THE SIZE IS CHECKED BEFORE ANY ARRAY IS READ, SO THAT A TRUNCATED FILE IS NEVER READ PAST ITS END
+	if (header.nnz > (long long)(size / (2 * sizeof(int))) || binaryMatrixSize(header.rows, header.nnz, header.headerSize) != size)
+	{
+		binaryFormatError(fileName, "the file size does not match the header");
+	}
+	return header;
+}
+
+unsigned long long rotateLeft(unsigned long long word, int bits)
+{
+	return (word << bits) | (word >> (64 - bits));
+}
+
+// MIXING ONE WORD INTO A LANE AS xxHash64 DOES. A MULTIPLICATION ONLY CARRIES A BIT TOWARDS THE HIGHER BITS,
+// SO THE ROTATION BRINGS THE HIGH BITS BACK DOWN BEFORE THE NEXT ONE: A CHANGE TO ANY BIT OF ANY WORD
+// THEN REACHES EVERY BIT OF THE LANE AFTER A FEW MORE WORDS
+unsigned long long mixWord(unsigned long long lane, unsigned long long word)
+{
+	lane += word * CHECKSUM_PRIME2;
+	lane = rotateLeft(lane, 31);
+	return lane * CHECKSUM_PRIME1;
+}
+
+// ADDING size BYTES TO THE FOUR LANES OF THE CHECKSUM
+void addToChecksum(unsigned long long lanes[4], const char *data, size_t size)
+{
+	size_t position = 0;
+	unsigned long long words[4];
+	for (; position + sizeof(words) <= size; position += sizeof(words))
+	{
+		memcpy(words, data + position, sizeof(words));
+		for (int lane = 0; lane < 4; lane++)
+		{
+			lanes[lane] = mixWord(lanes[lane], words[lane]);
+		}
+	}
+
+	// THE LAST BYTES ARE PADDED WITH ZEROS TO A FULL GROUP OF WORDS
+	if (position < size)
+	{
+		memset(words, 0, sizeof(words));
+		memcpy(words, data + position, size - position);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			lanes[lane] = mixWord(lanes[lane], words[lane]);
+		}
+	}
+}
+
+// COMBINING THE LANES OF THE CHECKSUM AS xxHash64 DOES, SO THAT EVERY BIT OF EVERY LANE CHANGES THE WHOLE RESULT
+unsigned long long finishChecksum(const unsigned long long lanes[4])
+{
+	unsigned long long checksum = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) +
+								  rotateLeft(lanes[3], 18);
+	for (int lane = 0; lane < 4; lane++)
+	{
+		checksum = (checksum ^ mixWord(0, lanes[lane])) * CHECKSUM_PRIME1 + CHECKSUM_PRIME3;
+	}
+	checksum = (checksum ^ (checksum >> 33)) * CHECKSUM_PRIME2;
+	checksum = (checksum ^ (checksum >> 29)) * CHECKSUM_PRIME3;
+	return checksum ^ (checksum >> 32);
+}
+
+unsigned long long hashBytes(const char *data, size_t size)
+{
+	unsigned long long lanes[4] = {CHECKSUM_SEED, CHECKSUM_SEED + 1, CHECKSUM_SEED + 2, CHECKSUM_SEED + 3};
+	addToChecksum(lanes, data, size);
+	return finishChecksum(lanes) ^ size;
+}
+
+unsigned long long binaryMatrixChecksum(const long *rowPtr, long rows, const int *colIdx, const int *values)
+{
+	unsigned long long lanes[4] = {CHECKSUM_SEED, CHECKSUM_SEED + 1, CHECKSUM_SEED + 2, CHECKSUM_SEED + 3};
+	addToChecksum(lanes, (const char *)rowPtr, (rows + 1) * sizeof(long));
+	addToChecksum(lanes, (const char *)colIdx, rowPtr[rows] * sizeof(int));
+	addToChecksum(lanes, (const char *)values, rowPtr[rows] * sizeof(int));
+	return finishChecksum(lanes);
+}
+
+void checkBinaryMatrixArrays(const long *rowPtr, const int *colIdx, const int *values,
+							 const BinaryMatrixHeader &header, const char *fileName)
+{
+	// THE ROW OFFSETS AND COLUMN NUMBERS ARE CHECKED ONE BY ONE BECAUSE EVERY READ OF THE MATRIX RELIES ON THEM
+	// TO STAY IN THE ARRAYS, AND THE MERGES AND SEARCHES ALSO RELY ON THE COLUMNS OF A ROW BEING SORTED
+	if (rowPtr[0] != 0 || rowPtr[header.rows] != header.nnz)
+	{
+		binaryFormatError(fileName, "the row offsets do not match the number of elements");
+	}
+	for (long long currRow = 0; currRow < header.rows; currRow++)
+	{
+		if (rowPtr[currRow + 1] < rowPtr[currRow] || rowPtr[currRow + 1] > header.nnz)
+		{
+			binaryFormatError(fileName, "the row offsets are not increasing from 0 to the number of elements");
+		}
+		int previousCol = -1;
+		for (long entry = rowPtr[currRow]; entry < rowPtr[currRow + 1]; entry++)
+		{
+			if (colIdx[entry] < 0 || colIdx[entry] >= header.cols)
+			{
+				binaryFormatError(fileName, "a column number is out of range");
+			}
+			if (colIdx[entry] <= previousCol)
+			{
+				binaryFormatError(fileName, "the column numbers of a row are not increasing");
+			}
+			previousCol = colIdx[entry];
+		}
+	}
+
+	if (binaryMatrixChecksum(rowPtr, header.rows, colIdx, values) != header.checksum)
+	{
+		binaryFormatError(fileName, "the checksum does not match, the file is corrupted");
+	}
+}
+
+bool writeAll(int fileDescriptor, const void *data, size_t size)
+{
+	const char *position = (const char *)data;
+	while (size > 0)
+	{
+		ssize_t written = write(fileDescriptor, position, size);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		position += written;
+		size -= written;
+	}
+	return true;
+}
+
+bool writeAllAt(int fileDescriptor, const void *data, size_t size, long long offset)
+{
+	const char *position = (const char *)data;
+	while (size > 0)
+	{
+		ssize_t written = pwrite(fileDescriptor, position, size, offset);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		position += written;
+		offset += written;
+		size -= written;
+	}
+	return true;
+}
@@ -0,0 +1,88 @@
+#ifndef MATRIXBINARYFORMAT_H_
+#define MATRIXBINARYFORMAT_H_
+
+#include <stddef.h>
+
+/**
+ * Binary matrix file format. A file holds a header followed by the three CSR
+ * arrays of a frozen matrix, exactly as they are laid out in memory, so that a
+ * matrix can be opened by mapping the file without parsing or copying it:
+ *
+ *     BinaryMatrixHeader   48 bytes
+ *     extra header bytes   headerSize - 48 bytes, a multiple of 8 (none by default)
+ *     rowPtr               rows + 1 signed 64-bit integers
+ *     colIdx               nnz signed 32-bit integers
+ *     values               nnz signed 32-bit integers
+ *
+ * All numbers are stored in the byte order of the machine that wrote the file;
+ * a file written with the other byte order fails the version check. The checksum
+ * covers the three arrays. Readers skip the extra header bytes they do not know,
+ * which is how the sidecar cache (MatrixFileCache.h) records the text file a
+ * binary file was made from.
+ */
+const char BINARY_MATRIX_MAGIC[8] = {'S', 'P', 'M', 'A', 'T', 'R', 'I', 'X'};
+const unsigned int BINARY_MATRIX_VERSION = 1;
+
+struct BinaryMatrixHeader
+{
+	char magic[8];				 // BINARY_MATRIX_MAGIC
+	unsigned int version;		 // BINARY_MATRIX_VERSION
+	unsigned int headerSize;	 // SIZE OF THE HEADER WITH ITS EXTRA BYTES, WHERE rowPtr STARTS
+	long long rows;
+	long long cols;
+	long long nnz;				 // NUMBER OF NON-ZERO ELEMENTS, rowPtr[rows]
+	unsigned long long checksum; // binaryMatrixChecksum OF THE THREE ARRAYS
+};
+
+/**
+ * Returns true if the data starts like a binary matrix file.
+ */
+bool isBinaryMatrix(const char *data, size_t size);
+
+/**
+ * Checks the header of a binary matrix file held in memory and that the file
+ * is as long as the header says. Throws invalid_argument naming the file if not.
+ */
+BinaryMatrixHeader readBinaryMatrixHeader(const char *data, size_t size, const char *fileName);
+
+/**
+ * Checks the arrays of a binary matrix file against its header: the row
+ * offsets must start at 0, never decrease and end at nnz, the column numbers
+ * of every row must be in 0 .. cols - 1 and strictly increasing, and the
+ * checksum must match. Throws invalid_argument naming the file if not.
+ */
+void checkBinaryMatrixArrays(const long *rowPtr, const int *colIdx, const int *values,
+							 const BinaryMatrixHeader &header, const char *fileName);
+
+/**
+ * Returns the size in bytes of a binary matrix file with the given dimensions and header size.
+ */
+size_t binaryMatrixSize(long long rows, long long nnz, size_t headerSize = sizeof(BinaryMatrixHeader));
+
+/**
+ * Returns a 64-bit hash of size bytes, read 8 bytes at a time over four
+ * independent lanes so that it runs at about the speed of reading memory.
+ * Every lane mixes its words with a multiply and a rotation, and the lanes are
+ * combined and avalanched at the end, following xxHash64, so that changing any
+ * bits of the input changes the hash (it is not a cryptographic hash).
+ */
+unsigned long long hashBytes(const char *data, size_t size);
+
+/**
+ * Returns the checksum of the three arrays of a binary matrix, hashed in the same way as hashBytes.
+ */
+unsigned long long binaryMatrixChecksum(const long *rowPtr, long rows, const int *colIdx, const int *values);
+
+/**
+ * Writes all the bytes to a file descriptor, retrying after partial writes.
+ * Returns false if a write fails.
+ */
+bool writeAll(int fileDescriptor, const void *data, size_t size);
+
+/**
+ * Writes all the bytes to a file descriptor at the given offset with pwrite, which
+ * several threads can do at once on the same file. Returns false if a write fails.
+ */
+bool writeAllAt(int fileDescriptor, const void *data, size_t size, long long offset);
+
+#endif /* MATRIXBINARYFORMAT_H_ */
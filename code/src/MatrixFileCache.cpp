@@ -0,0 +1,205 @@
+#include "MatrixFileCache.h"
+#include "MatrixBinaryFormat.h"
+#include "../../util/LogManager.h"
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+#include <ios>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+using namespace std;
+
+// EXTENSION OF THE CACHE FILES
+const char CACHE_EXTENSION[] = ".smbin";
+
+bool MatrixFileCache::enabled = false;
+string MatrixFileCache::directory;
+long long MatrixFileCache::maxSize = 0;
+bool MatrixFileCache::verifyContent = true;
+bool MatrixFileCache::refresh = false;
+
+void MatrixFileCache::setEnabled(bool enable)
+{
+	enabled = enable;
+}
+
+bool MatrixFileCache::isEnabled()
+{
+	return enabled;
+}
+
+void MatrixFileCache::setDirectory(const string &cacheDirectory)
+{
+	directory = cacheDirectory;
+}
+
+void MatrixFileCache::setMaxSize(long long bytes)
+{
+	maxSize = max(0LL, bytes);
+}
+
+void MatrixFileCache::setVerifyContent(bool verify)
+{
+	verifyContent = verify;
+}
+
+void MatrixFileCache::setRefresh(bool refreshEntries)
+{
+	refresh = refreshEntries;
+}
+
+string MatrixFileCache::cachePath(const char *sourcePath)
+{
+	if (directory.empty())
+	{
+		return string(sourcePath) + CACHE_EXTENSION;
+	}
+
+	// IN A CACHE DIRECTORY THE FILE IS NAMED AFTER THE TEXT FILE AND A HASH OF ITS FULL PATH,
+	// SO THAT TEXT FILES WITH THE SAME NAME IN DIFFERENT DIRECTORIES DO NOT SHARE A CACHE FILE
+	char fullPath[PATH_MAX];
+	string sourceName = realpath(sourcePath, fullPath) ? fullPath : sourcePath;
+	size_t slash = sourceName.find_last_of('/');
+	string baseName = (slash == string::npos) ? sourceName : sourceName.substr(slash + 1);
+	char pathHash[32];
+	snprintf(pathHash, sizeof(pathHash), "%016llx", hashBytes(sourceName.data(), sourceName.size()));
+	return directory + "/" + baseName + "." + pathHash + CACHE_EXTENSION;
+}
+
+bool MatrixFileCache::lookup(const char *sourcePath, const char *sourceText, size_t sourceSize,
+							 SourceStamp &stamp, MappedFile &cacheFile)
+{
+	// RECORDING THE TEXT FILE AS IT IS NOW. ITS CONTENT IS ONLY HASHED WHEN THE HASH IS NEEDED
+	struct stat sourceStatus;
+	memset(&stamp, 0, sizeof(stamp));
+	memcpy(stamp.tag, SOURCE_STAMP_TAG, sizeof(stamp.tag));
+	stamp.size = sourceSize;
+	if (stat(sourcePath, &sourceStatus) == 0)
+	{
+		stamp.mtimeSeconds = sourceStatus.st_mtim.tv_sec;
+		stamp.mtimeNanoseconds = sourceStatus.st_mtim.tv_nsec;
+	}
+	bool hashed = false;
+
+	string entryPath = cachePath(sourcePath);
+	if (!refresh && access(entryPath.c_str(), R_OK) == 0)
+	{
+		try
+		{
+			// READING THE RECORD FROM THE EXTRA HEADER BYTES OF THE CACHE FILE
+			MappedFile entry(entryPath.c_str());
+			BinaryMatrixHeader header = readBinaryMatrixHeader(entry.getData(), entry.getSize(), entryPath.c_str());
+			SourceStamp cached;
+			bool hasStamp = header.headerSize >= sizeof(BinaryMatrixHeader) + sizeof(SourceStamp);
+			if (hasStamp)
+			{
+				memcpy(&cached, entry.getData() + sizeof(BinaryMatrixHeader), sizeof(cached));
+				hasStamp = memcmp(cached.tag, SOURCE_STAMP_TAG, sizeof(cached.tag)) == 0;
+			}
+
+			// THE CHEAP CHECKS FIRST, THEN THE CONTENT HASH UNLESS IT IS TURNED OFF
+			if (hasStamp && cached.size == stamp.size && cached.mtimeSeconds == stamp.mtimeSeconds &&
+				cached.mtimeNanoseconds == stamp.mtimeNanoseconds)
+			{
+				if (verifyContent)
+				{
+					stamp.contentHash = hashBytes(sourceText, sourceSize);
+					hashed = true;
+				}
+				else
+				{
+					stamp.contentHash = cached.contentHash;
+				}
+				if (stamp.contentHash == cached.contentHash)
+				{
+					// MARKING THE FILE AS RECENTLY USED FOR THE SIZE LIMIT
+					utimensat(AT_FDCWD, entryPath.c_str(), NULL, 0);
+					cacheFile = std::move(entry);
+					return true;
+				}
+			}
+		}
+		catch (const exception &error)
+		{
+			LogManager::writePrintfToLog(LogManager::Level::Error, "MatrixFileCache::lookup",
+										 "Ignoring cache file %s: %s", entryPath.c_str(), error.what());
+		}
+	}
+
+	if (!hashed)
+	{
+		stamp.contentHash = hashBytes(sourceText, sourceSize);
+	}
+	return false;
+}
+
+bool MatrixFileCache::admits(size_t cacheFileSize)
+{
+	return maxSize == 0 || (long long)cacheFileSize <= maxSize;
+}
+
+void MatrixFileCache::prepare()
+{
+	if (!directory.empty())
+	{
+		mkdir(directory.c_str(), 0755);
+	}
+}
+
+void MatrixFileCache::trim(const string &keepPath)
+{
+	// CACHE FILES NEXT TO THE TEXT FILES ARE SPREAD OVER MANY DIRECTORIES, SO ONLY A CACHE DIRECTORY IS TRIMMED
+	if (directory.empty() || maxSize == 0)
+	{
+		return;
+	}
+	DIR *cacheDirectory = opendir(directory.c_str());
+	if (!cacheDirectory)
+	{
+		return;
+	}
+
+	// LISTING THE CACHE FILES WITH THEIR LAST USE AND SIZE
+	vector<pair<long long, pair<long long, string> > > entries;
+	long long totalSize = 0;
+	size_t extensionLength = strlen(CACHE_EXTENSION);
+	struct dirent *directoryEntry;
+	while ((directoryEntry = readdir(cacheDirectory)) != NULL)
+	{
+		string name = directoryEntry->d_name;
+		if (name.size() <= extensionLength || name.compare(name.size() - extensionLength, extensionLength, CACHE_EXTENSION) != 0)
+		{
+			continue;
+		}
+		string path = directory + "/" + name;
+		struct stat entryStatus;
+		if (stat(path.c_str(), &entryStatus) == 0)
+		{
+			long long lastUse = (long long)entryStatus.st_mtim.tv_sec * 1000000000LL + entryStatus.st_mtim.tv_nsec;
+			entries.push_back(make_pair(lastUse, make_pair((long long)entryStatus.st_size, path)));
+			totalSize += entryStatus.st_size;
+		}
+	}
+	closedir(cacheDirectory);
+
+	// REMOVING THE LEAST RECENTLY USED FILES FIRST
+	sort(entries.begin(), entries.end());
+	for (size_t i = 0; i < entries.size() && totalSize > maxSize; i++)
+	{
+		if (entries[i].second.second != keepPath && unlink(entries[i].second.second.c_str()) == 0)
+		{
+			totalSize -= entries[i].second.first;
+		}
+	}
+}
+
+void MatrixFileCache::invalidate(const char *sourcePath)
+{
+	unlink(cachePath(sourcePath).c_str());
+}
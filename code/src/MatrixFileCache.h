@@ -0,0 +1,95 @@
+#ifndef MATRIXFILECACHE_H_
+#define MATRIXFILECACHE_H_
+
+#include <string>
+#include "MappedFile.h"
+
+/**
+ * Record of the text file a cached binary matrix file was made from. It is
+ * stored in the extra header bytes of the binary file (see MatrixBinaryFormat.h).
+ */
+const char SOURCE_STAMP_TAG[8] = {'S', 'O', 'U', 'R', 'C', 'E', '0', '1'};
+
+struct SourceStamp
+{
+	char tag[8];					// SOURCE_STAMP_TAG
+	unsigned long long size;		// SIZE OF THE TEXT FILE IN BYTES
+	long long mtimeSeconds;			// LAST MODIFICATION TIME OF THE TEXT FILE
+	long long mtimeNanoseconds;
+	unsigned long long contentHash; // hashBytes OF THE WHOLE TEXT FILE
+};
+
+/**
+ * Opt-in cache of text matrix files in the binary format.
+ *
+ * When the cache is enabled, the first load of foo.txt writes its matrix to
+ * foo.txt.smbin next to it (or to a file in the cache directory, if one is set),
+ * and later loads open the binary file instead of parsing the text, as long as
+ * the size, modification time and content hash of the text file still match
+ * the ones recorded in the binary file.
+ *
+ * Settings, shared by all the loads:
+ *   - directory: where the cache files go. Empty (the default) puts them next to the text files.
+ *   - maximum size in bytes (0, the default, for no limit): a matrix whose cache file would be larger
+ *     is not cached, and in a cache directory the least recently used files are removed to keep the
+ *     total under the limit.
+ *   - content verification (on by default): with it off, only the size and modification time are
+ *     compared, so a hit never reads the text file.
+ *   - refresh: ignore the existing cache files and write them again.
+ *
+ * A cache file that cannot be written or read is logged and the text file is parsed as usual.
+ */
+class MatrixFileCache
+{
+private:
+	static bool enabled;
+	static std::string directory;
+	static long long maxSize;
+	static bool verifyContent;
+	static bool refresh;
+
+public:
+	static void setEnabled(bool enable);
+	static bool isEnabled();
+	static void setDirectory(const std::string &cacheDirectory);
+	static void setMaxSize(long long bytes);
+	static void setVerifyContent(bool verify);
+	static void setRefresh(bool refreshEntries);
+
+	/**
+	 * Returns the path of the cache file of a text file.
+	 */
+	static std::string cachePath(const char *sourcePath);
+
+	/**
+	 * Looks for a valid cache file for the text file sourcePath, whose contents are
+	 * sourceText. On a hit the cache file is mapped into cacheFile and true is returned.
+	 * In either case stamp is set to the record of the text file as it is now, ready to be
+	 * stored with a new cache file.
+	 */
+	static bool lookup(const char *sourcePath, const char *sourceText, size_t sourceSize,
+					   SourceStamp &stamp, MappedFile &cacheFile);
+
+	/**
+	 * Returns true if a cache file of the given size is allowed by the size limit.
+	 */
+	static bool admits(size_t cacheFileSize);
+
+	/**
+	 * Prepares the location of a cache file before it is written (creating the cache directory).
+	 */
+	static void prepare();
+
+	/**
+	 * Removes the least recently used files of the cache directory, but never keepPath,
+	 * until the cache is within its size limit.
+	 */
+	static void trim(const std::string &keepPath);
+
+	/**
+	 * Removes the cache file of a text file, if there is one.
+	 */
+	static void invalidate(const char *sourcePath);
+};
+
+#endif /* MATRIXFILECACHE_H_ */
@@ -0,0 +1,195 @@
+#include "MatrixRowReader.h"
+#include "MatrixBinaryFormat.h"
+#include <stdexcept>
+#include <stdio.h>
+using namespace std;
+
+// NUMBER OF BYTES READ BETWEEN TWO RELEASES OF THE PAGES THAT HAVE BEEN READ
+const long RELEASE_INTERVAL = 16 << 20;
+
+// THROWING AN ERROR ABOUT A FILE THAT CANNOT BE READ ROW BY ROW
+void rowReaderError(const char *filePath, const char *problem)
+{
+	char message[2048];
+	snprintf(message, sizeof(message), "Cannot read %s row by row: %s", filePath, problem);
+	throw invalid_argument(message);
+}
+
+MatrixRowReader::MatrixRowReader(const char *filePath)
+	: file(filePath)
+{
+	this->filePath = filePath;
+	nextRow = 0;
+	scanner = NULL;
+	hasPending = false;
+	released = file.getData();
+	fileRowPtr = NULL;
+	fileColIdx = NULL;
+	fileValues = NULL;
+	fileNnz = 0;
+	releasedRows = 0;
+	releasedEntries = 0;
+
+	// A BINARY FILE IS READ STRAIGHT FROM ITS ARRAYS
+	binary = isBinaryMatrix(file.getData(), file.getSize());
+	if (binary)
+	{
+		if (sizeof(long) != sizeof(long long))
+		{
+			rowReaderError(filePath, "binary matrix files need 64-bit row offsets");
+		}
+		BinaryMatrixHeader header = readBinaryMatrixHeader(file.getData(), file.getSize(), filePath);
+		rows = (int)header.rows;
+		cols = (int)header.cols;
+		fileRowPtr = (const long *)(file.getData() + header.headerSize);
+		fileColIdx = (const int *)(fileRowPtr + header.rows + 1);
+		fileValues = fileColIdx + header.nnz;
+		fileNnz = header.nnz;
+		if (fileRowPtr[0] != 0)
+		{
+			rowReaderError(filePath, "the row offsets do not start at 0");
+		}
+		return;
+	}
+
+	scanner = new MatrixScanner(file.getData(), file.getData(), file.getData() + file.getSize(), filePath);
+	try
+	{
+		format = scanner->readHeader();
+	}
+	catch (...)
+	{
+		delete scanner;
+		throw;
+	}
+	rows = format.rows;
+	cols = format.cols;
+
+	// THE ELEMENTS OF THE OTHER TRIANGLE OF A SYMMETRIC FILE BELONG TO ROWS THAT HAVE ALREADY BEEN READ
+	if (format.symmetry != MatrixMarketGeneral)
+	{
+		delete scanner;
+		rowReaderError(filePath, "a symmetric Matrix Market file lists one triangle and is not ordered by row");
+	}
+}
+
+MatrixRowReader::~MatrixRowReader()
+{
+	delete scanner;
+}
+
+int MatrixRowReader::getRows() const
+{
+	return rows;
+}
+
+int MatrixRowReader::getCols() const
+{
+	return cols;
+}
+
+void MatrixRowReader::readRow(vector<int> &rowCols, vector<int> &rowValues)
+{
+	rowCols.clear();
+	rowValues.clear();
+	if (nextRow >= rows)
+	{
+		rowReaderError(filePath, "every row has already been read");
+	}
+	if (binary)
+	{
+		readBinaryRow(rowCols, rowValues);
+	}
+	else
+	{
+		readTextRow(rowCols, rowValues);
+	}
+	nextRow++;
+}
+
+// READING THE ELEMENTS UNTIL ONE OF A LATER ROW IS FOUND, WHICH IS KEPT FOR THAT ROW
+void MatrixRowReader::readTextRow(vector<int> &rowCols, vector<int> &rowValues)
+{
+	if (hasPending)
+	{
+		if (pending.row != nextRow)
+		{
+			return;
+		}
+		rowCols.push_back(pending.col);
+		rowValues.push_back(pending.value);
+		hasPending = false;
+	}
+
+	MatrixEntry entry;
+	bool more;
+	while ((more = scanner->nextEntry(entry)))
+	{
+		if (entry.row > nextRow)
+		{
+			pending = entry;
+			hasPending = true;
+			break;
+		}
+		if (entry.row < nextRow)
+		{
+			char problem[256];
+			snprintf(problem, sizeof(problem), "an element of row %d comes after row %d, the file is not ordered by row", entry.row, nextRow);
+			rowReaderError(filePath, problem);
+		}
+		rowCols.push_back(entry.col);
+		rowValues.push_back(entry.value);
+	}
+
+	// THE WHOLE FILE HAS BEEN SCANNED ONCE THE LAST ROW IS READ
+	if (nextRow == rows - 1 && scanner->getSkippedEntries() > 0)
+	{
+		LogManager::writePrintfToLog(LogManager::Level::Error, "MatrixRowReader::readRow",
+									 "Skipped %ld elements of %s in column %d, one past the last column", scanner->getSkippedEntries(), filePath, cols);
+	}
+
+	// THE SIZE LINE OF A MATRIX MARKET FILE GIVES THE NUMBER OF ELEMENT LINES, WHICH CATCHES A TRUNCATED FILE
+	if (!more && format.matrixMarket && scanner->getLinesRead() != format.declaredEntries)
+	{
+		char message[256];
+		snprintf(message, sizeof(message), "%s declares %ld elements but has %ld", filePath, format.declaredEntries, scanner->getLinesRead());
+		throw invalid_argument(message);
+	}
+
+	// GIVING BACK THE PAGES OF THE TEXT THAT HAS BEEN READ
+	if (scanner->getPosition() - released >= RELEASE_INTERVAL)
+	{
+		file.release(released, scanner->getPosition());
+		released = scanner->getPosition();
+	}
+}
+
+// COPYING THE ROW FROM THE CSR ARRAYS OF THE FILE, CHECKING ITS OFFSETS AND COLUMNS ON THE WAY
+void MatrixRowReader::readBinaryRow(vector<int> &rowCols, vector<int> &rowValues)
+{
+	long first = fileRowPtr[nextRow];
+	long last = fileRowPtr[nextRow + 1];
+	if (last < first || last > fileNnz || (nextRow == rows - 1 && last != fileNnz))
+	{
+		rowReaderError(filePath, "the row offsets are not increasing from 0 to the number of elements");
+	}
+	for (long entry = first; entry < last; entry++)
+	{
+		if (fileColIdx[entry] < 0 || fileColIdx[entry] >= cols)
+		{
+			rowReaderError(filePath, "a column number is out of range");
+		}
+		rowCols.push_back(fileColIdx[entry]);
+		rowValues.push_back(fileValues[entry]);
+	}
+
+	// GIVING BACK THE PAGES OF THE THREE ARRAYS THAT HAVE BEEN READ
+	if ((nextRow - releasedRows) * (long)sizeof(long) + (last - releasedEntries) * (long)sizeof(int) >= RELEASE_INTERVAL)
+	{
+		file.release((const char *)(fileRowPtr + releasedRows), (const char *)(fileRowPtr + nextRow));
+		file.release((const char *)(fileColIdx + releasedEntries), (const char *)(fileColIdx + last));
+		file.release((const char *)(fileValues + releasedEntries), (const char *)(fileValues + last));
+		releasedRows = nextRow;
+		releasedEntries = last;
+	}
+}
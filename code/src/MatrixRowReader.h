@@ -0,0 +1,69 @@
+#ifndef MATRIXROWREADER_H_
+#define MATRIXROWREADER_H_
+
+#include <vector>
+#include "MappedFile.h"
+#include "MatrixScanner.h"
+
+/**
+ * Reads a matrix file one row at a time, for operations on matrices that do
+ * not fit in memory. Text, general Matrix Market and binary files are read,
+ * and their elements must be ordered by row (the columns of a row can come in
+ * any order). The file is mapped, and the pages that have been read are given
+ * back as the reader moves on, so the memory used does not grow with the size
+ * of the file.
+ *
+ * A binary file is not hashed against its checksum, which would need a full
+ * pass over the file first; its row offsets and column numbers are checked as
+ * the rows are read instead.
+ *
+ * Throws ios_base::failure if the file cannot be read, and invalid_argument if
+ * it is malformed, symmetric, or not ordered by row.
+ */
+class MatrixRowReader
+{
+private:
+	MappedFile file;
+	const char *filePath;
+	int rows;
+	int cols;
+	int nextRow; // ROW RETURNED BY THE NEXT CALL TO readRow
+
+	// TEXT AND MATRIX MARKET FILES
+	MatrixScanner *scanner;
+	MatrixFileFormat format;
+	bool hasPending; // THE FIRST ELEMENT OF A LATER ROW, READ WHILE LOOKING FOR THE END OF THE CURRENT ONE
+	MatrixEntry pending;
+	const char *released; // END OF THE PART OF THE TEXT WHOSE PAGES WERE GIVEN BACK
+
+	// BINARY FILES
+	bool binary;
+	const long *fileRowPtr;
+	const int *fileColIdx;
+	const int *fileValues;
+	long fileNnz;
+	int releasedRows;	  // NUMBER OF ROW OFFSETS WHOSE PAGES WERE GIVEN BACK
+	long releasedEntries; // NUMBER OF ELEMENTS OF colIdx AND values WHOSE PAGES WERE GIVEN BACK
+
+	void readTextRow(std::vector<int> &rowCols, std::vector<int> &rowValues);
+	void readBinaryRow(std::vector<int> &rowCols, std::vector<int> &rowValues);
+
+public:
+	MatrixRowReader(const char *filePath);
+	~MatrixRowReader();
+
+	MatrixRowReader(const MatrixRowReader &other) = delete;
+	MatrixRowReader &operator=(const MatrixRowReader &other) = delete;
+
+	int getRows() const;
+	int getCols() const;
+
+	/**
+	 * Replaces the contents of rowCols and rowValues with the elements of the
+	 * next row, in the order of the file. The rows are read from 0 to
+	 * getRows() - 1, and every row is read even when it is empty.
+	 */
+	void readRow(std::vector<int> &rowCols, std::vector<int> &rowValues);
+};
+
+#endif /* MATRIXROWREADER_H_ */
@@ -0,0 +1,433 @@
+#include "MatrixScanner.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <charconv>
+using namespace std;
+
+// LONGEST PART OF AN OFFENDING LINE QUOTED IN AN ERROR MESSAGE
+const int MAX_QUOTED_LENGTH = 80;
+
+MatrixScanner::MatrixScanner(const char *fileStart, const char *begin, const char *end, const char *fileName)
+{
+	this->fileStart = fileStart;
+	this->position = begin;
+	this->end = end;
+	this->fileName = fileName;
+	format.rows = INT_MAX;
+	format.cols = INT_MAX;
+	format.matrixMarket = false;
+	format.field = MatrixMarketInteger;
+	format.symmetry = MatrixMarketGeneral;
+	format.declaredEntries = 0;
+	linesRead = 0;
+	skippedEntries = 0;
+	hasMirror = false;
+}
+
+// THROWING AN ERROR FOR THE LINE STARTING AT lineStart, WITH ITS LINE NUMBER AND ITS TEXT.
+// THE LINES ARE ONLY COUNTED HERE, SO READING A VALID FILE NEVER PAYS FOR IT
+void MatrixScanner::fail(const char *lineStart, const char *problem)
+{
+	long lineNumber = 1 + count(fileStart, lineStart, '\n');
+	const char *lineEnd = find(lineStart, end, '\n');
+	while (lineEnd > lineStart && lineEnd[-1] == '\r')
+	{
+		lineEnd--;
+	}
+	string line(lineStart, min((long)(lineEnd - lineStart), (long)MAX_QUOTED_LENGTH));
+
+	char message[256 + MAX_QUOTED_LENGTH];
+	snprintf(message, sizeof(message), "Malformed line %ld in %s: %s, found \"%s\"", lineNumber, fileName, problem, line.c_str());
+	throw invalid_argument(message);
+}
+
+// SKIPPING SPACES, TABS AND CARRIAGE RETURNS, BUT NOT THE END OF THE LINE
+const char *MatrixScanner::skipSpaces(const char *at)
+{
+	while (at < end && (*at == ' ' || *at == '\t' || *at == '\r'))
+	{
+		at++;
+	}
+	return at;
+}
+
+// READING THE NUMBER OF ELEMENTS OF THE SIZE LINE, WHICH CAN BE LARGER THAN AN int, ONCE PER FILE WITH from_chars
+const char *MatrixScanner::readLong(const char *at, const char *lineStart, long &value)
+{
+	if (at < end && *at == '+')
+	{
+		at++;
+	}
+	from_chars_result result = from_chars(at, end, value);
+	if (result.ec == errc::invalid_argument)
+	{
+		fail(lineStart, "expected a number");
+	}
+	if (result.ec == errc::result_out_of_range)
+	{
+		fail(lineStart, "number does not fit in a long");
+	}
+	return result.ptr;
+}
+
+// READING AN OPTIONALLY SIGNED DECIMAL NUMBER THAT MUST FIT IN AN int
+const char *MatrixScanner::readInt(const char *at, const char *lineStart, int &value)
+{
+	bool negative = false;
+	if (at < end && (*at == '-' || *at == '+'))
+	{
+		negative = (*at == '-');
+		at++;
+	}
+	if (at == end || *at < '0' || *at > '9')
+	{
+		fail(lineStart, "expected a number");
+	}
+
+	// THE MAGNITUDE IS CHECKED AGAINST 2^31 ON EVERY DIGIT, SO IT CANNOT OVERFLOW HOWEVER LONG THE NUMBER IS
+	long long magnitude = 0;
+	while (at < end && *at >= '0' && *at <= '9')
+	{
+		magnitude = magnitude * 10 + (*at - '0');
+		if (magnitude > (long long)INT_MAX + 1)
+		{
+			fail(lineStart, "number does not fit in an int");
+		}
+		at++;
+	}
+	if (!negative && magnitude > INT_MAX)
+	{
+		fail(lineStart, "number does not fit in an int");
+	}
+	value = (int)(negative ? -magnitude : magnitude);
+	return at;
+}
+
+// READING A WORD (A RUN OF CHARACTERS OTHER THAN SPACES) THAT MUST BE ONE OF words, IGNORING CASE.
+// index IS SET TO THE POSITION OF THE WORD IN words
+const char *MatrixScanner::readWord(const char *at, const char *lineStart, const char *const *words, int numWords, int &index)
+{
+	at = skipSpaces(at);
+	const char *wordEnd = at;
+	while (wordEnd < end && *wordEnd != ' ' && *wordEnd != '\t' && *wordEnd != '\r' && *wordEnd != '\n')
+	{
+		wordEnd++;
+	}
+	for (index = 0; index < numWords; index++)
+	{
+		if ((size_t)(wordEnd - at) == strlen(words[index]) && strncasecmp(at, words[index], wordEnd - at) == 0)
+		{
+			return wordEnd;
+		}
+	}
+	fail(lineStart, "unsupported Matrix Market header, expected \"%%MatrixMarket matrix coordinate integer|real|pattern general|symmetric|skew-symmetric\"");
+}
+
+// READING A REAL NUMBER AND ROUNDING IT TO THE NEAREST int, WHICH IS HOW THE MATRIX STORES IT
+const char *MatrixScanner::readReal(const char *at, const char *lineStart, int &value)
+{
+	// from_chars DOES NOT ACCEPT A LEADING +
+	if (at < end && *at == '+')
+	{
+		at++;
+	}
+	double number;
+	from_chars_result result = from_chars(at, end, number);
+	if (result.ec != errc() || result.ptr == at)
+	{
+		fail(lineStart, "expected a number");
+	}
+	if (!(number > (double)INT_MIN - 0.5 && number < (double)INT_MAX + 0.5))
+	{
+		fail(lineStart, "number does not fit in an int");
+	}
+	value = (int)lround(number);
+	return result.ptr;
+}
+
+// MOVING PAST BLANK LINES, AND PAST MATRIX MARKET COMMENT LINES STARTING WITH % WHEN skipComments IS SET.
+// RETURNS THE START OF THE NEXT LINE WITH TEXT, OR NULL AT THE END OF THE TEXT
+const char *MatrixScanner::skipBlankLines(bool skipComments)
+{
+	while (true)
+	{
+		const char *at = skipSpaces(position);
+		if (at == end)
+		{
+			position = end;
+			return NULL;
+		}
+		if (*at != '\n' && !(skipComments && *at == '%'))
+		{
+			return position;
+		}
+		at = find(at, end, '\n');
+		position = (at < end) ? at + 1 : end;
+	}
+}
+
+MatrixFileFormat MatrixScanner::readHeader()
+{
+	const char *lineStart = skipBlankLines(false);
+	const char banner[] = "%%MatrixMarket";
+	if (lineStart && (size_t)(end - lineStart) >= strlen(banner) && strncasecmp(lineStart, banner, strlen(banner)) == 0)
+	{
+		readMatrixMarketHeader();
+	}
+	else
+	{
+		readNativeHeader();
+	}
+	return format;
+}
+
+// READING THE rows= AND cols= LINES
+void MatrixScanner::readNativeHeader()
+{
+	const char *keys[2] = {"rows", "cols"};
+	int *dimensions[2] = {&format.rows, &format.cols};
+	for (int line = 0; line < 2; line++)
+	{
+		const char *lineStart = skipBlankLines(false);
+		if (!lineStart)
+		{
+			fail(end, line == 0 ? "expected rows=<number>" : "expected cols=<number>");
+		}
+
+		// READING <key> = <number> AND NOTHING ELSE ON THE LINE
+		const char *at = skipSpaces(lineStart);
+		size_t keyLength = strlen(keys[line]);
+		if ((size_t)(end - at) < keyLength || memcmp(at, keys[line], keyLength) != 0)
+		{
+			fail(lineStart, line == 0 ? "expected rows=<number>" : "expected cols=<number>");
+		}
+		at = skipSpaces(at + keyLength);
+		if (at == end || *at != '=')
+		{
+			fail(lineStart, line == 0 ? "expected rows=<number>" : "expected cols=<number>");
+		}
+		at = readInt(skipSpaces(at + 1), lineStart, *dimensions[line]);
+		at = skipSpaces(at);
+		if (at < end && *at != '\n')
+		{
+			fail(lineStart, "unexpected text after the number");
+		}
+		if (*dimensions[line] <= 0)
+		{
+			fail(lineStart, "number of rows and columns must be positive");
+		}
+		position = (at < end) ? at + 1 : end;
+	}
+	format.matrixMarket = false;
+}
+
+// READING THE %%MatrixMarket BANNER, THE COMMENTS AND THE SIZE LINE
+void MatrixScanner::readMatrixMarketHeader()
+{
+	const char *lineStart = skipBlankLines(false);
+	const char *objects[1] = {"matrix"};
+	const char *formats[1] = {"coordinate"};
+	const char *fields[3] = {"integer", "real", "pattern"};
+	const char *symmetries[3] = {"general", "symmetric", "skew-symmetric"};
+	int index;
+	const char *at = lineStart + strlen("%%MatrixMarket");
+	at = readWord(at, lineStart, objects, 1, index);
+	at = readWord(at, lineStart, formats, 1, index);
+	at = readWord(at, lineStart, fields, 3, index);
+	format.field = (MatrixMarketField)index;
+	at = readWord(at, lineStart, symmetries, 3, index);
+	format.symmetry = (MatrixMarketSymmetry)index;
+	at = skipSpaces(at);
+	if (at < end && *at != '\n')
+	{
+		fail(lineStart, "unexpected text after the Matrix Market header");
+	}
+	position = (at < end) ? at + 1 : end;
+
+	// READING <rows> <cols> <number of lines> AFTER THE COMMENTS
+	lineStart = skipBlankLines(true);
+	if (!lineStart)
+	{
+		fail(end, "expected the size line <rows> <cols> <entries>");
+	}
+	at = readInt(skipSpaces(lineStart), lineStart, format.rows);
+	at = readInt(skipSpaces(at), lineStart, format.cols);
+	long declaredEntries;
+	at = readLong(skipSpaces(at), lineStart, declaredEntries);
+	at = skipSpaces(at);
+	if (at < end && *at != '\n')
+	{
+		fail(lineStart, "unexpected text after the size line");
+	}
+	if (format.rows <= 0 || format.cols <= 0 || declaredEntries < 0)
+	{
+		fail(lineStart, "number of rows and columns must be positive");
+	}
+	if (format.symmetry != MatrixMarketGeneral && format.rows != format.cols)
+	{
+		fail(lineStart, "a symmetric matrix must be square");
+	}
+	format.declaredEntries = declaredEntries;
+	format.matrixMarket = true;
+	position = (at < end) ? at + 1 : end;
+}
+
+void MatrixScanner::setFormat(const MatrixFileFormat &fileFormat)
+{
+	format = fileFormat;
+}
+
+bool MatrixScanner::nextEntry(MatrixEntry &entry)
+{
+	if (hasMirror)
+	{
+		entry = mirror;
+		hasMirror = false;
+		return true;
+	}
+	return format.matrixMarket ? nextMatrixMarketEntry(entry) : nextNativeEntry(entry);
+}
+
+// READING A (row, col, value) LINE
+bool MatrixScanner::nextNativeEntry(MatrixEntry &entry)
+{
+	while (true)
+	{
+		const char *lineStart = skipBlankLines(false);
+		if (!lineStart)
+		{
+			return false;
+		}
+
+		// READING ( <row> , <col> , <value> ) WITH OPTIONAL SPACES BETWEEN ALL OF THEM
+		const char *at = skipSpaces(lineStart);
+		if (*at != '(')
+		{
+			fail(lineStart, "expected (row, col, value)");
+		}
+		at = readInt(skipSpaces(at + 1), lineStart, entry.row);
+		at = skipSpaces(at);
+		if (at == end || *at != ',')
+		{
+			fail(lineStart, "expected a comma after the row number");
+		}
+		at = readInt(skipSpaces(at + 1), lineStart, entry.col);
+		at = skipSpaces(at);
+		if (at == end || *at != ',')
+		{
+			fail(lineStart, "expected a comma after the column number");
+		}
+		at = readInt(skipSpaces(at + 1), lineStart, entry.value);
+		at = skipSpaces(at);
+		if (at == end || *at != ')')
+		{
+			fail(lineStart, "expected a closing parenthesis after the value");
+		}
+		at = skipSpaces(at + 1);
+		if (at < end && *at != '\n')
+		{
+			fail(lineStart, "unexpected text after the element");
+		}
+		position = (at < end) ? at + 1 : end;
+		linesRead++;
+
+		// THE ORIGINAL LOADER ACCEPTED A COLUMN EQUAL TO THE NUMBER OF COLUMNS BUT NEVER PRINTED, ADDED OR MULTIPLIED
+		// SUCH AN ELEMENT, AND SOME SAMPLE FILES HAVE THEM: THEY ARE SKIPPED AND COUNTED, WHICH KEEPS THEIR OUTPUTS
+		if (entry.col == format.cols && entry.row >= 0 && entry.row < format.rows)
+		{
+			skippedEntries++;
+			continue;
+		}
+		if (entry.row < 0 || entry.row >= format.rows || entry.col < 0 || entry.col >= format.cols)
+		{
+			fail(lineStart, "row or column number is out of range");
+		}
+		return true;
+	}
+}
+
+// READING A <row> <col> [<value>] LINE, WITH ROWS AND COLUMNS STARTING AT 1
+bool MatrixScanner::nextMatrixMarketEntry(MatrixEntry &entry)
+{
+	const char *lineStart = skipBlankLines(true);
+	if (!lineStart)
+	{
+		return false;
+	}
+
+	const char *at = readInt(skipSpaces(lineStart), lineStart, entry.row);
+	const char *separator = at;
+	at = skipSpaces(at);
+	if (at == separator)
+	{
+		fail(lineStart, "expected a space after the row number");
+	}
+	at = readInt(at, lineStart, entry.col);
+	if (format.field == MatrixMarketPattern)
+	{
+		entry.value = 1;
+	}
+	else
+	{
+		separator = at;
+		at = skipSpaces(at);
+		if (at == separator)
+		{
+			fail(lineStart, "expected a space after the column number");
+		}
+		at = (format.field == MatrixMarketInteger) ? readInt(at, lineStart, entry.value) : readReal(at, lineStart, entry.value);
+	}
+	at = skipSpaces(at);
+	if (at < end && *at != '\n')
+	{
+		fail(lineStart, "unexpected text after the element");
+	}
+
+	if (entry.row < 1 || entry.row > format.rows || entry.col < 1 || entry.col > format.cols)
+	{
+		fail(lineStart, "row or column number is out of range");
+	}
+	entry.row--;
+	entry.col--;
+	position = (at < end) ? at + 1 : end;
+	linesRead++;
+
+	// A SYMMETRIC FILE LISTS ONE TRIANGLE: THE ELEMENT OF THE OTHER TRIANGLE IS RETURNED NEXT
+	if (format.symmetry != MatrixMarketGeneral && entry.row != entry.col)
+	{
+		mirror.row = entry.col;
+		mirror.col = entry.row;
+		mirror.value = (format.symmetry == MatrixMarketSymmetric) ? entry.value : (int)(0u - (unsigned int)entry.value);
+		hasMirror = true;
+	}
+	return true;
+}
+
+void MatrixScanner::readEntries(vector<MatrixEntry> &entries)
+{
+	MatrixEntry entry;
+	while (nextEntry(entry))
+	{
+		entries.push_back(entry);
+	}
+}
+
+const char *MatrixScanner::getPosition() const
+{
+	return position;
+}
+
+long MatrixScanner::getLinesRead() const
+{
+	return linesRead;
+}
+
+long MatrixScanner::getSkippedEntries() const
+{
+	return skippedEntries;
+}
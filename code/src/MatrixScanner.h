@@ -0,0 +1,135 @@
+#ifndef MATRIXSCANNER_H_
+#define MATRIXSCANNER_H_
+
+#include <vector>
+#include "SparseMatrix.h"
+
+// KIND OF VALUES IN A MATRIX MARKET FILE
+enum MatrixMarketField
+{
+	MatrixMarketInteger,
+	MatrixMarketReal,
+	MatrixMarketPattern // NO VALUES: EVERY ELEMENT LISTED IS 1
+};
+
+// WHICH ELEMENTS A MATRIX MARKET FILE LISTS
+enum MatrixMarketSymmetry
+{
+	MatrixMarketGeneral,	  // ALL OF THEM
+	MatrixMarketSymmetric,	  // THE LOWER TRIANGLE, (j, i) IS EQUAL TO (i, j)
+	MatrixMarketSkewSymmetric // THE LOWER TRIANGLE, (j, i) IS THE OPPOSITE OF (i, j)
+};
+
+// FORMAT OF A MATRIX FILE, AS READ FROM ITS HEADER
+struct MatrixFileFormat
+{
+	int rows;
+	int cols;
+	bool matrixMarket; // FALSE FOR THE rows=/cols= FORMAT
+	MatrixMarketField field;
+	MatrixMarketSymmetry symmetry;
+	long declaredEntries; // NUMBER OF ELEMENT LINES GIVEN IN A MATRIX MARKET SIZE LINE
+};
+
+/**
+ * Reads the text of a matrix file held in memory (for example a MappedFile).
+ * Two formats are recognized from the first line:
+ *
+ *     rows=<number>                 %%MatrixMarket matrix coordinate <field> <symmetry>
+ *     cols=<number>                 % comment lines
+ *     (<row>, <col>, <value>)       <rows> <cols> <number of lines>
+ *     ...                           <row> <col> <value>
+ *                                   ...
+ *
+ * Matrix Market rows and columns start at 1 and are converted to start at 0.
+ * The field is integer, real (rounded to the nearest int) or pattern (no value,
+ * the element is 1), and the symmetry is general, symmetric or skew-symmetric.
+ * For the last two, only one triangle is listed and the scanner returns every
+ * element off the diagonal twice, once for each triangle.
+ *
+ * Spaces and tabs are allowed around every number and symbol, blank lines are
+ * skipped, and lines may end with "\n" or "\r\n". The numbers are read with a
+ * hand-written loop (from_chars for real values): there is no locale handling
+ * and no library call per line.
+ *
+ * Anything else is an error: the scanner throws invalid_argument with the file
+ * name, the line number and the text of the offending line. Row and column
+ * numbers outside the dimensions of the header are reported the same way,
+ * except a column equal to cols in the rows=/cols= format, which is skipped
+ * (see getSkippedEntries).
+ */
+class MatrixScanner
+{
+private:
+	const char *fileStart; // START OF THE WHOLE FILE, TO COUNT THE LINES WHEN AN ERROR IS REPORTED
+	const char *position;
+	const char *end;
+	const char *fileName;
+	MatrixFileFormat format;
+	long linesRead; // NUMBER OF ELEMENT LINES READ
+	long skippedEntries; // NUMBER OF ELEMENTS IN COLUMN cols, SEE getSkippedEntries
+
+	// ELEMENT OF THE OTHER TRIANGLE OF A SYMMETRIC MATRIX, RETURNED BY THE NEXT CALL TO nextEntry
+	bool hasMirror;
+	MatrixEntry mirror;
+
+	[[noreturn]] void fail(const char *lineStart, const char *problem);
+	const char *skipSpaces(const char *at);
+	const char *readInt(const char *at, const char *lineStart, int &value);
+	const char *readLong(const char *at, const char *lineStart, long &value);
+	const char *readReal(const char *at, const char *lineStart, int &value);
+	const char *readWord(const char *at, const char *lineStart, const char *const *words, int numWords, int &index);
+	const char *skipBlankLines(bool skipComments);
+	void readNativeHeader();
+	void readMatrixMarketHeader();
+	bool nextNativeEntry(MatrixEntry &entry);
+	bool nextMatrixMarketEntry(MatrixEntry &entry);
+
+public:
+	/**
+	 * Scans the bytes begin .. end - 1 of a file that starts at fileStart.
+	 * Starting somewhere else than the start of the file lets parts of the
+	 * file be scanned separately, with the right line numbers in the errors.
+	 */
+	MatrixScanner(const char *fileStart, const char *begin, const char *end, const char *fileName);
+
+	/**
+	 * Reads the header of either format. The dimensions must be positive.
+	 */
+	MatrixFileFormat readHeader();
+
+	/**
+	 * Sets the format of the elements, when the header was read by another scanner.
+	 */
+	void setFormat(const MatrixFileFormat &fileFormat);
+
+	/**
+	 * Reads the next element into entry. Returns false at the end of the text.
+	 */
+	bool nextEntry(MatrixEntry &entry);
+
+	/**
+	 * Reads all the remaining elements and appends them to entries.
+	 */
+	void readEntries(std::vector<MatrixEntry> &entries);
+
+	/**
+	 * Returns where the scanner is: the start of the next line to read.
+	 */
+	const char *getPosition() const;
+
+	/**
+	 * Returns the number of element lines read so far, which for a symmetric
+	 * matrix can be less than the number of elements returned.
+	 */
+	long getLinesRead() const;
+
+	/**
+	 * Returns the number of elements of the rows=/cols= format skipped so far because their column is equal to
+	 * the number of columns. The original loader accepted such an element but never printed or used it, and
+	 * some of the sample files have them, so the scanner skips them instead of failing.
+	 */
+	long getSkippedEntries() const;
+};
+
+#endif /* MATRIXSCANNER_H_ */
@@ -3,418 +3,2021 @@
  *      Author: kompalli
  */
 #include "SparseMatrix.h"
+#include "WorkScheduler.h"
+#include "MappedFile.h"
+#include "MatrixScanner.h"
+#include "MatrixBinaryFormat.h"
+#include "MatrixFileCache.h"
+#include "MatrixRowReader.h"
+#include "VectorKernels.h"
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <string>
+#include <charconv>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 using namespace std;
 
+// NUMBER OF THREADS USED BY THE MATRIX OPERATIONS
+int SparseMatrix::numThreads = max(1, (int)thread::hardware_concurrency());
+
+// BELOW THIS AMOUNT OF WORK (ELEMENTS VISITED OR PRODUCTS COMPUTED), AN OPERATION RUNS ON THE CALLING THREAD ONLY
+const long PARALLEL_MIN_WORK = 1 << 16;
+
+// NUMBER OF PIECES AN INPUT FILE IS CUT INTO FOR EVERY THREAD THAT SCANS IT, SO THAT THREADS THAT FINISH EARLY CAN TAKE OVER PIECES
+const int PIECES_PER_WORKER = 16;
+
 // SETTING THE ERROR MESSAGE TO BE DISPLAYED
 void errorMessage(const char *msg)
 {
 	throw invalid_argument(msg);
 }
 
-// FUNCTION TO CREATE A NODE
-Node *createNode(int currRow, int currCol, int value)
+// FUNCTION TO CHOOSE HOW MANY THREADS TO USE FOR AN OPERATION FROM THE AMOUNT OF WORK IT HAS TO DO
+int chooseNumWorkers(long work, int numItems)
 {
-	// CREATING A NEW NODE
-	Node *data = new Node;
-	data->row = currRow;
-	data->col = currCol;
-	data->value = value;
-	data->left = NULL;
-	data->right = NULL;
-
-	// RETURNING THE NEW NODE
-	return data;
+	if (work < PARALLEL_MIN_WORK)
+	{
+		return 1;
+	}
+	return max(1, min(SparseMatrix::getNumThreads(), numItems));
 }
 
-// CONSTRUCTOR TO INITIALIZE THE SPARSE MATRIX WITH THE GIVEN NUMBER OF ROWS AND COLUMNS
-SparseMatrix::SparseMatrix(int numRows, int numCols)
+// SETTING THE NUMBER OF THREADS USED BY THE MATRIX OPERATIONS
+void SparseMatrix::setNumThreads(int threads)
 {
-	// CHECKING IF THE NUMBER OF ROWS AND COLUMNS ARE POSITIVE, NOT EXCEEDING THE MAXIMUM LIMIT AND NOT ZERO
-	if (numRows <= 0 || numCols <= 0)
+	if (threads <= 0)
 	{
-		errorMessage("Number of rows and columns is incorrect!");
+		errorMessage("Number of threads must be positive");
 	}
+	numThreads = threads;
+}
 
-	// SETTING THE NUMBER OF ROWS AND COLUMNS OF THE MATRIX TO THE GIVEN VALUES OF THE PARAMETERS
-	rows = numRows;
-	cols = numCols;
+int SparseMatrix::getNumThreads()
+{
+	return numThreads;
+}
 
-	// CREATING AN ARRAY OF BINARY SEARCH TREES WITH SIZE = NUMBER OF ROWS OF THE MATRIX
-	// TO STORE NON-ZERO ELEMENTS WITH THE SAME ROW NUMBER IN A SORTED ORDER IN THE BINARY SEARCH TREE
-	treesArr = new BSTree[rows];
+NodeArena::NodeArena()
+{
+	slabSize = 0;
+	slabUsed = 0;
+	freeList = NULL;
 }
 
-// SETTING AND ADDING ELEMENT IN THE MATRIX
-int SparseMatrix::setElement(int currRow, int currCol, int value)
+NodeArena::~NodeArena()
 {
-	// CHECKING IF THE ROW AND COLUMN NUMBER IS WITHIN THE RANGE OF THE MATRIX
-	if (currRow < 0 || currRow > rows || currCol < 0 || currCol > cols)
-	{
-		errorMessage("Row or column number is out of range");
-	}
+	releaseAll();
+}
 
-	// CHECKING IF THE VALUE IS ZERO AND RETURN 1
-	if (value == 0)
+NodeArena::NodeArena(NodeArena &&other)
+{
+	slabs.swap(other.slabs);
+	slabSize = other.slabSize;
+	slabUsed = other.slabUsed;
+	freeList = other.freeList;
+	other.slabSize = 0;
+	other.slabUsed = 0;
+	other.freeList = NULL;
+}
+
+NodeArena &NodeArena::operator=(NodeArena &&other)
+{
+	if (this != &other)
 	{
-		return 1;
+		releaseAll();
+		slabs.swap(other.slabs);
+		slabSize = other.slabSize;
+		slabUsed = other.slabUsed;
+		freeList = other.freeList;
+		other.slabSize = 0;
+		other.slabUsed = 0;
+		other.freeList = NULL;
 	}
+	return *this;
+}
 
-	// POINTER FOR THE CURRENT NODE OF THE BST TO TRAVERSE THE BST
-	Node *currentNode = treesArr[currRow].root;
-
-	// IF THE BST IS EMPTY OR THE ELEMENT IS NOT PRESENT IN THE BST (BASE CASE), THEN ADD THE ELEMENT TO THE BST
-	if (currentNode == NULL)
+// TAKING A NODE FROM THE FREE LIST, OR CARVING IT FROM THE CURRENT SLAB
+Node *NodeArena::allocate()
+{
+	if (freeList != NULL)
 	{
-		// ADDING THE NEW NODE TO THE BST BY SETTING THE ROOT OF THE BST TO THE NEW NODE
-		treesArr[currRow].root = createNode(currRow, currCol, value);
+		Node *node = freeList;
+		freeList = node->right;
+		return node;
 	}
 
-	// CHECKING IF THE ELEMENT IS PRESENT IN THE BST
-	else
+	// STARTING A NEW SLAB, TWICE AS LARGE AS THE PREVIOUS ONE, WHEN THE CURRENT ONE IS FULL
+	if (slabUsed == slabSize)
 	{
-		while (currentNode != NULL)
+		long newSlabSize = 2 * slabSize;
+		if (newSlabSize < MIN_SLAB_NODES)
 		{
-			// IF THE ELEMENT IS AT THE CURRENT NODE, THEN UPDATE THE VALUE OF THE ELEMENT
-			if (currentNode->col == currCol)
-			{
-				currentNode->value = value;
-				return 1;
-			}
-
-			// IF THE COLUMN NUMBER OF THE ELEMENT IS LESS THAN THE COLUMN NUMBER OF THE CURRENT NODE,
-			// THEN TRAVERSE TO THE LEFT CHILD
-			else if (currentNode->col > currCol)
-			{
-				// IF THE LEFT CHILD IS NULL, THEN ADD THE ELEMENT TO THE LEFT CHILD
-				if (currentNode->left == NULL)
-				{
-
-					// SETTING THE LEFT CHILD OF THE CURRENT NODE TO THE NEW NODE
-					currentNode->left = createNode(currRow, currCol, value);
-					return 1;
-				}
-
-				// TRAVERSING TO THE LEFT CHILD OF THE CURRENT NODE IF THE LEFT CHILD IS NOT NULL
-				else
-				{
-					currentNode = currentNode->left;
-				}
-			}
-
-			// ADD THE ELEMENT TO THE RIGHT DEPENDING ON THE COLUMN NUMBER IN ORDER TO BE SORTED BINARLY
-			else
-			{
-				// CHECKING IF THE RIGHT CHILD IS NULL
-				if (currentNode->right == NULL)
-				{
-					// SETTING THE RIGHT CHILD OF THE CURRENT NODE TO THE NEW NODE
-					currentNode->right = createNode(currRow, currCol, value);
-					return 1;
-				}
-
-				// TRAVERSING TO THE RIGHT CHILD
-				else
-				{
-					currentNode = currentNode->right;
-				}
-			}
+			newSlabSize = MIN_SLAB_NODES;
 		}
+		if (newSlabSize > MAX_SLAB_NODES)
+		{
+			newSlabSize = MAX_SLAB_NODES;
+		}
+		reserve(newSlabSize);
 	}
+	return slabs.back() + slabUsed++;
+}
 
-	return 1;
+// PUSHING A NODE ON THE FREE LIST
+void NodeArena::release(Node *node)
+{
+	node->right = freeList;
+	freeList = node;
 }
 
-// GETTING THE ELEMENT FROM THE MATRIX AT THE GIVEN ROW AND COLUMN
-int SparseMatrix::getElement(int currRow, int currCol)
+// STARTING A NEW SLAB IF THE CURRENT ONE HAS LESS THAN numNodes NODES LEFT
+void NodeArena::reserve(long numNodes)
 {
-	// CHECKING IF THE ROW AND COLUMN NUMBER IS WITHIN THE RANGE OF THE MATRIX
-	if (currRow < 0 || currRow > rows || currCol < 0 || currCol > cols)
+	if (slabSize - slabUsed >= numNodes)
 	{
-		errorMessage("Row or column number is out of range");
+		return;
 	}
+	slabs.push_back(new Node[numNodes]);
+	slabSize = numNodes;
+	slabUsed = 0;
+}
 
-	// CHECKING IF THE BST IS EMPTY
-	if (treesArr[currRow].root == NULL)
+// DELETING ALL THE SLABS
+void NodeArena::releaseAll()
+{
+	for (size_t i = 0; i < slabs.size(); i++)
 	{
-		return 0;
+		delete[] slabs[i];
 	}
+	slabs.clear();
+	slabSize = 0;
+	slabUsed = 0;
+	freeList = NULL;
+}
 
-	// FINDING THE ELEMENT USING BINARY SEARCH
-	Node *currentNode = treesArr[currRow].root;
+// FUNCTION TO CREATE A NODE
+Node *createNode(NodeArena &arena, int currRow, int currCol, int value)
+{
+	// CREATING A NEW NODE
+	Node *data = arena.allocate();
+	data->row = currRow;
+	data->col = currCol;
+	data->value = value;
+	data->height = 1;
+	data->left = NULL;
+	data->right = NULL;
 
-	while (currentNode != NULL)
+	// RETURNING THE NEW NODE
+	return data;
+}
+
+// FUNCTION TO GET THE HEIGHT OF A SUBTREE (0 FOR AN EMPTY SUBTREE)
+int nodeHeight(Node *node)
+{
+	if (node == NULL)
 	{
-		// FOUND THE ELEMENT AT THE CURRENT NODE AND RETURNING THE VALUE OF THE ELEMENT
-		if (currentNode->col == currCol)
-		{
-			return currentNode->value;
-		}
+		return 0;
+	}
+	return node->height;
+}
 
-		// CHECKING IF THE ELEMENT IS PRESENT IN THE LEFT SUBTREE OF THE BST
-		else if (currentNode->col > currCol)
+// FUNCTION TO RECOMPUTE THE HEIGHT OF A NODE FROM THE HEIGHTS OF ITS CHILDREN
+void updateHeight(Node *node)
+{
+	node->height = 1 + max(nodeHeight(node->left), nodeHeight(node->right));
+}
+
+// FUNCTION TO ROTATE A SUBTREE TO THE RIGHT AND RETURN ITS NEW ROOT
+Node *rotateRight(Node *node)
+{
+	Node *newRoot = node->left;
+	node->left = newRoot->right;
+	newRoot->right = node;
+	updateHeight(node);
+	updateHeight(newRoot);
+	return newRoot;
+}
+
+// FUNCTION TO ROTATE A SUBTREE TO THE LEFT AND RETURN ITS NEW ROOT
+Node *rotateLeft(Node *node)
+{
+	Node *newRoot = node->right;
+	node->right = newRoot->left;
+	newRoot->left = node;
+	updateHeight(node);
+	updateHeight(newRoot);
+	return newRoot;
+}
+
+// FUNCTION TO RESTORE THE AVL PROPERTY (HEIGHTS OF THE TWO SUBTREES DIFFER BY AT MOST 1) AT A NODE
+Node *rebalance(Node *node)
+{
+	updateHeight(node);
+	int balance = nodeHeight(node->left) - nodeHeight(node->right);
+
+	// THE LEFT SUBTREE IS TOO HIGH
+	if (balance > 1)
+	{
+		// LEFT-RIGHT CASE: THE LEFT CHILD LEANS RIGHT, SO IT IS ROTATED LEFT FIRST
+		if (nodeHeight(node->left->left) < nodeHeight(node->left->right))
 		{
-			currentNode = currentNode->left;
+			node->left = rotateLeft(node->left);
 		}
+		return rotateRight(node);
+	}
 
-		// CHECKING IF THE ELEMENT IS PRESENT IN THE RIGHT SUBTREE OF THE BST
-		else
+	// THE RIGHT SUBTREE IS TOO HIGH
+	if (balance < -1)
+	{
+		// RIGHT-LEFT CASE: THE RIGHT CHILD LEANS LEFT, SO IT IS ROTATED RIGHT FIRST
+		if (nodeHeight(node->right->right) < nodeHeight(node->right->left))
 		{
-			currentNode = currentNode->right;
+			node->right = rotateRight(node->right);
 		}
+		return rotateLeft(node);
 	}
 
-	return 0;
+	return node;
 }
 
-// READING THE MATRIX FROM THE FILE AND STORING IT
-SparseMatrix::SparseMatrix(char *matrixFilePath)
+// FUNCTION TO INSERT AN ELEMENT IN AN AVL TREE, OR UPDATE ITS VALUE IF THE COLUMN IS ALREADY PRESENT,
+// AND RETURN THE NEW ROOT OF THE TREE
+Node *insertNode(NodeArena &arena, Node *root, int currRow, int currCol, int value)
 {
-	FILE *inFileStream = fopen(matrixFilePath, "r");
-	if (!inFileStream)
+	// THE ELEMENT IS NOT PRESENT IN THE TREE (BASE CASE), SO A NEW LEAF IS CREATED
+	if (root == NULL)
 	{
-		char *message = new char[2048];
-		sprintf(message, "Cannot open input file for reading");
-		throw ios_base::failure(message);
-		delete[] message;
+		return createNode(arena, currRow, currCol, value);
 	}
-	LogManager::writePrintfToLog(LogManager::Level::Status, "SparseMatrix::SparseMatrix",
-								 "Loading input file: %s", matrixFilePath);
 
-	// READING THE NUMBER OF ROWS AND COLUMNS FROM THE FILE USING fgets
-	int row, col, value;
-	char *line = new char[2048];
+	// IF THE ELEMENT IS AT THE CURRENT NODE, THEN UPDATE THE VALUE OF THE ELEMENT
+	if (root->col == currCol)
+	{
+		root->value = value;
+		return root;
+	}
 
-	// READING THE NUMBER OF ROWS FROM THE FILE
-	fgets(line, 2048, inFileStream);
-	sscanf(line, "rows=%d", &row);
-	rows = row;
+	// INSERTING IN THE LEFT OR RIGHT SUBTREE DEPENDING ON THE COLUMN NUMBER IN ORDER TO BE SORTED BINARLY
+	if (root->col > currCol)
+	{
+		root->left = insertNode(arena, root->left, currRow, currCol, value);
+	}
+	else
+	{
+		root->right = insertNode(arena, root->right, currRow, currCol, value);
+	}
 
-	// READING THE NUMBER OF COLUMNS FROM THE FILE
-	fgets(line, 2048, inFileStream);
-	sscanf(line, "cols=%d", &col);
-	cols = col;
+	// REBALANCING ON THE WAY BACK UP SO THAT THE HEIGHT OF THE TREE STAYS O(log k) FOR ANY INSERTION ORDER
+	return rebalance(root);
+}
 
-	// CREATING THE BST ARRAY OF SIZE ROWS
-	treesArr = new BSTree[rows];
+// FUNCTION TO REMOVE THE ELEMENT WITH THE GIVEN COLUMN FROM AN AVL TREE, IF PRESENT,
+// GIVING ITS NODE BACK TO THE ARENA AND RETURNING THE NEW ROOT OF THE TREE
+Node *removeNode(NodeArena &arena, Node *root, int currCol)
+{
+	// THE ELEMENT IS NOT PRESENT IN THE TREE
+	if (root == NULL)
+	{
+		return NULL;
+	}
 
-	// READING THE ELEMENTS FROM THE FILE AND STORING THEM IN THE BST
-	while (fgets(line, 2048, inFileStream))
+	if (root->col > currCol)
+	{
+		root->left = removeNode(arena, root->left, currCol);
+	}
+	else if (root->col < currCol)
 	{
-		sscanf(line, "(%d, %d, %d)", &row, &col, &value); // READING THE ELEMENTS FROM THE FILE
-		setElement(row, col, value); // SETTING THE ELEMENT IN THE MATRIX
+		root->right = removeNode(arena, root->right, currCol);
 	}
 
-	// CLOSING THE INPUT FILE
-	fclose(inFileStream);
+	// THE ELEMENT IS AT THE CURRENT NODE
+	else
+	{
+		// WITH AT MOST ONE CHILD, THE CHILD TAKES THE PLACE OF THE NODE
+		if (root->left == NULL || root->right == NULL)
+		{
+			Node *child = root->left != NULL ? root->left : root->right;
+			arena.release(root);
+			return child;
+		}
+
+		// WITH TWO CHILDREN, THE NEXT ELEMENT OF THE ROW (SMALLEST COLUMN OF THE RIGHT SUBTREE) IS MOVED HERE
+		Node *successor = root->right;
+		while (successor->left != NULL)
+		{
+			successor = successor->left;
+		}
+		root->col = successor->col;
+		root->value = successor->value;
+		root->right = removeNode(arena, root->right, successor->col);
+	}
 
-	// DELETING THE LINE
-	delete[] line;
+	return rebalance(root);
 }
 
-void SparseMatrix::printToASCIIFile(char *outputFileName)
+// FUNCTION TO COUNT THE NODES OF A BST
+long countNodes(Node *root)
 {
-	FILE *outFileStream = fopen(outputFileName, "w");
-	if (!outFileStream)
+	if (root == NULL)
 	{
-		char *message = new char[2048];
-		sprintf(message, "Cannot open output file for writing");
-		throw ios_base::failure(message);
-		delete[] message;
+		return 0;
 	}
-	LogManager::writePrintfToLog(LogManager::Level::Status, "SparseMatrix::printToASCIIFile",
-								 "Writing matrix to file: %s", outputFileName);
-	fprintf(outFileStream, "rows=%d\n", rows);
-	fprintf(outFileStream, "cols=%d\n", cols);
-	int value;
-	for (int currRow = 0; currRow < rows; currRow++)
-		for (int currCol = 0; currCol < cols; currCol++)
-		{
-			value = getElement(currRow, currCol);
-			if (value != 0)
-			{
-				fprintf(outFileStream, "(%d, %d, %d)\n", currRow, currCol, value);
-			}
-		}
-	fclose(outFileStream);
+	return 1 + countNodes(root->left) + countNodes(root->right);
 }
 
-// ADDING THE TWO MATRICES AND RETURNING THE RESULT
-SparseMatrix SparseMatrix::operator+(SparseMatrix &inputObject)
+// FUNCTION TO COPY THE NODES OF A BST IN INCREASING COLUMN ORDER (IN-ORDER TRAVERSAL) TO THE CSR ARRAYS
+void copyToCSR(Node *root, int *colIdx, int *values, long &position)
 {
-	if (rows != inputObject.rows) // CHECKING IF THE NUMBER OF ROWS ARE EQUAL
+	if (root == NULL)
 	{
-		char *message = new char[2048];
-		sprintf(message, "Number of rows are not same");
-		throw invalid_argument(message);
-		delete[] message;
+		return;
 	}
+	copyToCSR(root->left, colIdx, values, position);
+	colIdx[position] = root->col;
+	values[position] = root->value;
+	position++;
+	copyToCSR(root->right, colIdx, values, position);
+}
 
-	if (cols != inputObject.cols) // CHECKING IF THE NUMBER OF COLUMNS ARE EQUAL
+// FUNCTION TO COPY A BST WITH THE SAME SHAPE, TAKING THE NEW NODES FROM THE GIVEN ARENA
+Node *copyTree(NodeArena &arena, Node *root)
+{
+	if (root == NULL)
 	{
-		char *message = new char[2048];
-		sprintf(message, "Number of cols are not same");
-		throw invalid_argument(message);
-		delete[] message;
+		return NULL;
 	}
+	Node *copy = createNode(arena, root->row, root->col, root->value);
+	copy->height = root->height;
+	copy->left = copyTree(arena, root->left);
+	copy->right = copyTree(arena, root->right);
+	return copy;
+}
 
-	// CREATING THE RESULT MATRIX OBJECT TO STORE THE RESULT OF ADDITION OF THE TWO MATRICES
-	SparseMatrix resultMat(inputObject.rows, inputObject.cols);
-	int nbr;
+// FUNCTION TO ADD (sign = 1) OR SUBTRACT (sign = -1) TWO SORTED ROWS BY MERGING THEM IN COLUMN ORDER,
+// WRITING THE NON-ZERO RESULTS TO THE OUTPUT ROW.
+// RETURNS THE NUMBER OF ELEMENTS WRITTEN, WHICH IS AT MOST size1 + size2
+long mergeRows(const int *cols1, const int *values1, long size1,
+			   const int *cols2, const int *values2, long size2, int sign,
+			   int *outCols, int *outValues)
+{
+	long position1 = 0;
+	long position2 = 0;
+	long written = 0;
 
-	// ADDING THE TWO MATRICES AND STORING THE RESULT IN THE RESULT MATRIX OBJECT CREATED
-	for (int currRow = 0; currRow < inputObject.rows; currRow++)
+	// TAKING THE ELEMENT WITH THE SMALLER COLUMN FROM EITHER ROW, OR THE SUM OF BOTH WHEN THE COLUMNS ARE EQUAL
+	while (position1 < size1 && position2 < size2)
 	{
-		// SKIP EMPTY ROWS FOR FASTER ADDITION ON LARGE MATRICES (IF BOTH ROWS ARE EMPTY)
-		if (treesArr[currRow].root == NULL && inputObject.treesArr[currRow].root == NULL)
-		{
-			continue;
-		}
-
-		// IF THE ROW IN THE FIRST MATRIX IS EMPTY, COPY THE ROW FROM THE SECOND MATRIX TO THE RESULT MATRIX
-		else if (treesArr[currRow].root == NULL)
+		if (cols1[position1] < cols2[position2])
 		{
-			resultMat.treesArr[currRow] = inputObject.treesArr[currRow];
-			continue;
+			outCols[written] = cols1[position1];
+			outValues[written] = values1[position1];
+			written++;
+			position1++;
 		}
-
-		// IF THE ROW IN THE SECOND MATRIX IS EMPTY, COPY THE ROW FROM THE FIRST MATRIX TO THE RESULT MATRIX
-		else if (inputObject.treesArr[currRow].root == NULL)
+		else if (cols2[position2] < cols1[position1])
 		{
-			resultMat.treesArr[currRow] = treesArr[currRow];
-			continue;
+			outCols[written] = cols2[position2];
+			outValues[written] = sign * values2[position2];
+			written++;
+			position2++;
 		}
-
-		// IF BOTH ROWS ARE NOT EMPTY, ADD THE TWO ROWS AND STORE THE RESULT IN THE RESULT MATRIX
 		else
 		{
-			// ADDING THE TWO ROWS AND STORING THE RESULT IN THE RESULT MATRIX
-			for (int currCol = 0; currCol < inputObject.cols; currCol++)
-			{
-				// ADD THE CORRESPONDING ELEMENTS FROM THE TWO ROWS
-				nbr = getElement(currRow, currCol) + inputObject.getElement(currRow, currCol);
+			int nbr = values1[position1] + sign * values2[position2];
 
-				// IF THE RESULT IS NOT ZERO, STORE IT IN THE RESULT MATRIX
-				if (nbr != 0)
-				{
-					// SET THE ELEMENT IN THE RESULT MATRIX
-					resultMat.setElement(currRow, currCol, nbr);
-				}
+			// IF THE RESULT IS NOT ZERO, STORE IT IN THE OUTPUT ROW
+			if (nbr != 0)
+			{
+				outCols[written] = cols1[position1];
+				outValues[written] = nbr;
+				written++;
 			}
+			position1++;
+			position2++;
 		}
 	}
 
-	// RETURN THE RESULT MATRIX
-	return resultMat;
-}
-
-// SUBTRACTING THE TWO MATRICES AND STORING THE RESULT IN THE RESULT MATRIX OBJECT CREATED
-SparseMatrix SparseMatrix::operator-(SparseMatrix &inputObject)
-{
-	if (inputObject.rows != rows) // CHECKING IF THE NUMBER OF ROWS ARE EQUAL
+	// COPYING WHAT IS LEFT OF THE ROW THAT IS NOT EXHAUSTED
+	for (; position1 < size1; position1++)
 	{
-		char *message = new char[2048];
-		sprintf(message, "Number of rows are not same");
-		throw invalid_argument(message);
-		delete[] message;
+		outCols[written] = cols1[position1];
+		outValues[written] = values1[position1];
+		written++;
 	}
-
-	if (inputObject.cols != cols) // CHECKING IF THE NUMBER OF COLUMNS ARE EQUAL
+	for (; position2 < size2; position2++)
 	{
-		char *message = new char[2048];
-		sprintf(message, "Number of cols are not same");
-		throw invalid_argument(message);
-		delete[] message;
+		outCols[written] = cols2[position2];
+		outValues[written] = sign * values2[position2];
+		written++;
 	}
 
-	// CREATING THE RESULT MATRIX OBJECT TO STORE THE RESULT OF SUBTRACTION OF THE TWO MATRICES
-	SparseMatrix resultMat(rows, cols);
-	int nbr;
-
-	// SUBTRACTING THE TWO MATRICES AND STORING THE RESULT IN THE RESULT MATRIX OBJECT CREATED
-	for (int currRow = 0; currRow < rows; currRow++)
-	{
-		Node *ptrToNode1 = treesArr[currRow].root;			   // POINTING TO THE ROOT OF THE FIRST ROW
-		Node *ptrToNode2 = inputObject.treesArr[currRow].root; // POINTING TO THE ROOT OF THE SECOND ROW
+	return written;
+}
 
-		// IF BOTH ROWS ARE EMPTY, SKIP THE ROW (FOR FASTER SUBTRACTION ON LARGE MATRICES)
-		while (ptrToNode1 != NULL || ptrToNode2 != NULL)
-		{
-			// GET THE COLUMN NUMBER OF THE FIRST ELEMENT IN THE ROW
-			int col1 = 0;
-			int col2 = 0;
+// SIZE OF THE BUFFER IN WHICH AN OUTPUT FILE IS FORMATTED BEFORE IT IS WRITTEN
+const size_t OUTPUT_BUFFER_SIZE = 1 << 20;
 
-			// IF THE FIRST ROW IS NOT EMPTY, GET THE COLUMN NUMBER OF THE FIRST ELEMENT IN THE ROW
-			if(ptrToNode1 != NULL)
-			{
-				col1 = ptrToNode1->col;
-			}
+// LONGEST LINE OF AN OUTPUT FILE: "(" + 3 NUMBERS OF AT MOST 11 CHARACTERS + 2 SEPARATORS ", " + ")\n"
+const size_t MAX_LINE_LENGTH = 1 + 3 * 11 + 2 * 2 + 2;
 
-			// ELSE, GET THE COLUMN NUMBER OF THE LAST ELEMENT IN THE ROW
-			else
-			{
-				col1 = cols;
-			}			
+// CHARACTERS OF A "(row, col, value)" LINE THAT ARE NOT DIGITS OR SIGNS
+const long LINE_PUNCTUATION_LENGTH = 7;
 
-			// GET THE COLUMN NUMBER OF THE SECOND ELEMENT IN THE ROW			
-			if(ptrToNode2 != NULL)
-			{	
-				col2 = ptrToNode2->col; // GET THE COLUMN NUMBER OF THE SECOND ELEMENT IN THE ROW
-			}
-			else
-			{
-				col2 = cols; // ELSE, GET THE COLUMN NUMBER OF THE LAST ELEMENT IN THE ROW
-			} 
+// LONGEST DECIMAL FORM OF AN int: A SIGN AND 10 DIGITS
+const int MAX_INT_LENGTH = 11;
 
-			// IF THE FIRST ROW HAS MORE ELEMENTS THAN THE SECOND ROW, 
-			// IT MEANS THAT THE ELEMENTS IN THE SECOND ROW ARE ZERO AND CAN BE SKIPPED
-			if (col1 < col2)
-			{
-				// SET THE ELEMENT IN THE RESULT MATRIX
-				resultMat.setElement(currRow, col1, ptrToNode1->value);
+// FUNCTION TO FORMAT AN INTEGER IN DECIMAL AT THE GIVEN POSITION AND RETURN THE POSITION AFTER IT.
+// to_chars WRITES THE SAME CHARACTERS AS printf("%d"), WITHOUT LOCALE OR FORMAT STRING
+char *writeInt(char *position, int number)
+{
+	return to_chars(position, position + MAX_INT_LENGTH, number).ptr;
+}
 
-				// MOVE TO THE NEXT ELEMENT IN THE ROW
-				ptrToNode1 = ptrToNode1->right;
-			}
+// FUNCTION TO COUNT THE CHARACTERS writeInt WRITES FOR AN INTEGER
+int intLength(int number)
+{
+	// WORKING ON THE MAGNITUDE AS AN UNSIGNED NUMBER SO THAT INT_MIN IS COUNTED CORRECTLY
+	unsigned int magnitude = number;
+	int length = 1;
+	if (number < 0)
+	{
+		magnitude = 0u - magnitude;
+		length++;
+	}
+	while (magnitude >= 10)
+	{
+		magnitude /= 10;
+		length++;
+	}
+	return length;
+}
 
-			// IF THE SECOND ROW HAS MORE ELEMENTS THAN THE FIRST ROW
-			// IT MEANS THAT THE ELEMENTS IN THE FIRST ROW ARE ZERO AND CAN BE SKIPPED
-			else if (col2 < col1)
-			{
-				// SET THE ELEMENT IN THE RESULT MATRIX
-				resultMat.setElement(currRow, col2, -1 * ptrToNode2->value);
+// FUNCTION TO FORMAT THE "rows=" AND "cols=" LINES OF AN OUTPUT FILE
+char *writeHeader(char *position, int numRows, int numCols)
+{
+	memcpy(position, "rows=", 5);
+	position = writeInt(position + 5, numRows);
+	*position++ = '\n';
+	memcpy(position, "cols=", 5);
+	position = writeInt(position + 5, numCols);
+	*position++ = '\n';
+	return position;
+}
 
-				// MOVE TO THE NEXT ELEMENT IN THE ROW
-				ptrToNode2 = ptrToNode2->right;
-			}
+// FUNCTION TO FORMAT ONE "<row> <col> <value>" LINE OF A MATRIX MARKET FILE, WITH ROWS AND COLUMNS STARTING AT 1
+char *writeMatrixMarketEntry(char *position, int currRow, int currCol, int value)
+{
+	position = writeInt(position, currRow + 1);
+	*position++ = ' ';
+	position = writeInt(position, currCol + 1);
+	*position++ = ' ';
+	position = writeInt(position, value);
+	*position++ = '\n';
+	return position;
+}
 
-			// IF THE TWO ROWS HAVE THE SAME NUMBER OF ELEMENTS
-			else
-			{
-				// ADD THE CORRESPONDING ELEMENTS FROM THE TWO ROWS
-				nbr = ptrToNode1->value - ptrToNode2->value;
+// FUNCTION TO FORMAT ONE "(row, col, value)" LINE OF AN OUTPUT FILE
+char *writeEntry(char *position, int currRow, int currCol, int value)
+{
+	*position++ = '(';
+	position = writeInt(position, currRow);
+	*position++ = ',';
+	*position++ = ' ';
+	position = writeInt(position, currCol);
+	*position++ = ',';
+	*position++ = ' ';
+	position = writeInt(position, value);
+	*position++ = ')';
+	*position++ = '\n';
+	return position;
+}
 
-				// IF THE RESULT IS NOT ZERO, STORE IT IN THE RESULT MATRIX
-				if (nbr != 0)
-				{
-					// SET THE ELEMENT IN THE RESULT MATRIX
-					resultMat.setElement(currRow, col1, nbr);
-				}
+// FUNCTION TO WRITE THE FORMATTED PART OF A BUFFER TO A FILE. RETURNS FALSE IF THE WRITE FAILED
+bool flushBuffer(FILE *outFileStream, const char *buffer, const char *end)
+{
+	size_t size = end - buffer;
+	return fwrite(buffer, 1, size, outFileStream) == size;
+}
 
-				// MOVE TO THE NEXT ELEMENT IN THE ROW FOR THE 1ST MATRIX
-				ptrToNode1 = ptrToNode1->right;
+// WIDTH OF THE NUMBER OF ELEMENTS IN THE SIZE LINE OF A MATRIX MARKET FILE WRITTEN ROW BY ROW, ENOUGH FOR ANY long
+const int SIZE_FIELD_WIDTH = 20;
 
-				// MOVE TO THE NEXT ELEMENT IN THE ROW FOR THE 2ND MATRIX
-				ptrToNode2 = ptrToNode2->right;
-			}
+// WRITER OF AN OUTPUT FILE THAT RECEIVES THE ROWS OF A RESULT ONE AFTER THE OTHER, FOR RESULTS THAT ARE NEVER HELD
+// IN MEMORY AS A WHOLE. THE NUMBER OF ELEMENTS OF A MATRIX MARKET FILE IS ONLY KNOWN AT THE END, SO ITS SIZE LINE IS
+// WRITTEN WITH SPACES IN PLACE OF THE NUMBER, WHICH close() WRITES OVER
+class RowStreamWriter
+{
+private:
+	FILE *outFileStream;
+	char *buffer;
+	char *limit;
+	char *position;
+	bool matrixMarket;
+	long sizeFieldOffset;
+	long numEntries;
+	bool writeFailed;
+
+public:
+	RowStreamWriter(const char *outputFileName, int numRows, int numCols, bool matrixMarket)
+	{
+		outFileStream = fopen(outputFileName, "w");
+		if (!outFileStream)
+		{
+			throw ios_base::failure("Cannot open output file for writing");
 		}
-	}
+		buffer = new char[OUTPUT_BUFFER_SIZE];
+		limit = buffer + OUTPUT_BUFFER_SIZE - MAX_LINE_LENGTH;
+		this->matrixMarket = matrixMarket;
+		numEntries = 0;
+		writeFailed = false;
 
-	// RETURN THE RESULT MATRIX
+		if (matrixMarket)
+		{
+			position = buffer + sprintf(buffer, "%%%%MatrixMarket matrix coordinate integer general\n%d %d ", numRows, numCols);
+			sizeFieldOffset = position - buffer;
+			memset(position, ' ', SIZE_FIELD_WIDTH);
+			position += SIZE_FIELD_WIDTH;
+			*position++ = '\n';
+		}
+		else
+		{
+			position = writeHeader(buffer, numRows, numCols);
+		}
+	}
+
+	~RowStreamWriter()
+	{
+		if (outFileStream)
+		{
+			fclose(outFileStream);
+		}
+		delete[] buffer;
+	}
+
+	void writeRow(int currRow, const int *rowCols, const int *rowValues, long size)
+	{
+		for (long entry = 0; entry < size && !writeFailed; entry++)
+		{
+			position = matrixMarket ? writeMatrixMarketEntry(position, currRow, rowCols[entry], rowValues[entry])
+									: writeEntry(position, currRow, rowCols[entry], rowValues[entry]);
+			if (position > limit)
+			{
+				writeFailed = !flushBuffer(outFileStream, buffer, position);
+				position = buffer;
+			}
+		}
+		numEntries += size;
+	}
+
+	// WRITING WHAT IS LEFT IN THE BUFFER AND THE NUMBER OF ELEMENTS, AND CLOSING THE FILE
+	void close()
+	{
+		if (!writeFailed)
+		{
+			writeFailed = !flushBuffer(outFileStream, buffer, position);
+		}
+		if (matrixMarket && !writeFailed)
+		{
+			char sizeField[SIZE_FIELD_WIDTH + 1];
+			int length = snprintf(sizeField, sizeof(sizeField), "%ld", numEntries);
+			writeFailed = fseek(outFileStream, sizeFieldOffset, SEEK_SET) != 0 || fwrite(sizeField, 1, length, outFileStream) != (size_t)length;
+		}
+		int closeResult = fclose(outFileStream);
+		outFileStream = NULL;
+		if (closeResult != 0 || writeFailed)
+		{
+			throw ios_base::failure("Cannot write to output file");
+		}
+	}
+};
+
+// READ-ONLY POINTERS TO THE CSR ARRAYS OF A FROZEN MATRIX, PASSED TO THE PRODUCT KERNELS
+struct CSRArrays
+{
+	const long *rowPtr;
+	const int *colIdx;
+	const int *values;
+};
+
+// FUNCTION TO COUNT THE PRODUCTS ADDED INTO ROW i OF first * second, WHICH BOUNDS THE NUMBER OF ELEMENTS OF THAT ROW
+long countProducts(const CSRArrays &first, const CSRArrays &second, int i)
+{
+	long products = 0;
+	for (long position = first.rowPtr[i]; position < first.rowPtr[i + 1]; position++)
+	{
+		int j = first.colIdx[position];
+		products += second.rowPtr[j + 1] - second.rowPtr[j];
+	}
+	return products;
+}
+
+// FUNCTION TO GET THE PREFIX SUM OF THE WORK OF EVERY ROW OF first * second FOR THE SCHEDULER: THE PRODUCTS OF THE ROW,
+// PLUS ONE FOR VISITING THE ROW EVEN WHEN IT IS EMPTY
+vector<long> productWorkPrefix(const CSRArrays &first, const CSRArrays &second, int numRows)
+{
+	vector<long> workPrefix(numRows + 1, 0);
+	for (int i = 0; i < numRows; i++)
+	{
+		workPrefix[i + 1] = workPrefix[i] + countProducts(first, second, i) + 1;
+	}
+	return workPrefix;
+}
+
+// A DENSE ACCUMULATOR IS USED FOR A ROW WHEN THE ACCUMULATOR FITS IN THE CACHE (256 KB)
+// OR WHEN THE ROW MAY FILL AT LEAST 1/16 OF ITS COLUMNS. OTHER ROWS USE A HASH TABLE SIZED TO THE ROW
+const int DENSE_ACCUMULATOR_MAX_COLS = 1 << 16;
+const int DENSE_ACCUMULATOR_MIN_FILL = 16;
+
+// WORKSPACE TO COMPUTE THE ROWS OF A PRODUCT ONE AT A TIME, IN TWO PHASES.
+// THE SYMBOLIC PHASE FINDS THE COLUMNS OF A ROW, WITH A DENSE MARKER ARRAY AS WIDE AS THE RESULT FOR ROWS THAT MAY
+// HAVE MANY ELEMENTS AND AN OPEN-ADDRESSING HASH SET FOR ROWS THAT CAN ONLY HAVE A FEW.
+// THE NUMERIC PHASE ADDS THE PRODUCTS INTO THE COLUMNS FOUND BY THE SYMBOLIC PHASE, WITH A DENSE ACCUMULATOR
+// FOR THE SAME ROWS AS ABOVE AND A BINARY SEARCH IN THE SORTED COLUMNS OF THE ROW FOR THE OTHERS
+class ProductRowWorkspace
+{
+private:
+	int numCols;
+
+	// DENSE ACCUMULATOR, ALLOCATED ON THE FIRST ROW THAT NEEDS IT, WITH THE LAST ROW THAT TOUCHED EACH COLUMN
+	// AND THE LIST OF COLUMNS TOUCHED BY THE CURRENT ROW
+	vector<int> accumulator;
+	vector<int> lastRow;
+	vector<int> touchedCols;
+
+	// HASH TABLE WITH LINEAR PROBING, HOLDING THE COLUMNS OF THE CURRENT ROW (-1 FOR AN EMPTY SLOT)
+	// AND, IN THE NUMERIC PHASE, THE POSITION OF EVERY COLUMN IN THE STRUCTURE OF THE ROW
+	vector<int> hashKeys;
+	vector<long> hashPositions;
+
+	bool useDense(long maxEntries);
+	void allocateDense();
+	size_t prepareHash(long maxEntries);
+	size_t findSlot(int k, size_t mask);
+
+public:
+	ProductRowWorkspace(int numCols);
+
+	// FINDS THE COLUMNS OF ROW i OF first * second AND APPENDS THEM IN INCREASING ORDER TO outCols
+	void symbolicRow(const CSRArrays &first, const CSRArrays &second, int i, vector<int> &outCols);
+
+	// COMPUTES ROW i OF first * second, WHOSE COLUMNS ARE THE size SORTED COLUMNS structCols GIVEN BY THE SYMBOLIC PHASE.
+	// WRITES THE NON-ZERO ELEMENTS IN COLUMN ORDER AND RETURNS HOW MANY WERE WRITTEN,
+	// OR -1 IF A PRODUCT FALLS IN A COLUMN THAT IS NOT IN structCols
+	long numericRow(const CSRArrays &first, const CSRArrays &second, int i, const int *structCols, long size,
+					int *outCols, int *outValues);
+};
+
+ProductRowWorkspace::ProductRowWorkspace(int numCols)
+{
+	this->numCols = numCols;
+}
+
+// CHOOSING BETWEEN THE DENSE AND THE HASH ACCUMULATOR FROM THE NUMBER OF ELEMENTS THE ROW CAN HAVE
+bool ProductRowWorkspace::useDense(long maxEntries)
+{
+	return numCols <= DENSE_ACCUMULATOR_MAX_COLS || maxEntries * DENSE_ACCUMULATOR_MIN_FILL >= numCols;
+}
+
+void ProductRowWorkspace::allocateDense()
+{
+	if (accumulator.empty())
+	{
+		accumulator.assign(numCols, 0);
+		lastRow.assign(numCols, -1);
+	}
+}
+
+// SIZING THE HASH TABLE TO A POWER OF TWO AT LEAST TWICE THE NUMBER OF ELEMENTS THE ROW CAN HAVE, AND RETURNING ITS MASK
+size_t ProductRowWorkspace::prepareHash(long maxEntries)
+{
+	size_t tableSize = 16;
+	while (tableSize < (size_t)(2 * maxEntries))
+	{
+		tableSize *= 2;
+	}
+	if (hashKeys.size() < tableSize)
+	{
+		hashKeys.assign(tableSize, -1);
+		hashPositions.resize(tableSize);
+	}
+	touchedCols.clear();
+	return tableSize - 1;
+}
+
+// RETURNING THE SLOT HOLDING COLUMN k, OR THE EMPTY SLOT WHERE IT WOULD GO
+size_t ProductRowWorkspace::findSlot(int k, size_t mask)
+{
+	// PROBING THE NEXT SLOTS WHEN A SLOT HOLDS ANOTHER COLUMN
+	size_t slot = ((unsigned int)k * 2654435761u) & mask;
+	while (hashKeys[slot] != k && hashKeys[slot] != -1)
+	{
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+void ProductRowWorkspace::symbolicRow(const CSRArrays &first, const CSRArrays &second, int i, vector<int> &outCols)
+{
+	long maxEntries = min(countProducts(first, second, i), (long)numCols);
+	if (maxEntries == 0)
+	{
+		return;
+	}
+	size_t rowFirst = outCols.size();
+
+	// MARKING THE COLUMNS TOUCHED BY THE ROW IN THE DENSE MARKER ARRAY
+	if (useDense(maxEntries))
+	{
+		allocateDense();
+		for (long position = first.rowPtr[i]; position < first.rowPtr[i + 1]; position++)
+		{
+			int j = first.colIdx[position];
+			for (long position2 = second.rowPtr[j]; position2 < second.rowPtr[j + 1]; position2++)
+			{
+				int k = second.colIdx[position2];
+				if (lastRow[k] != i)
+				{
+					lastRow[k] = i;
+					outCols.push_back(k);
+				}
+			}
+		}
+	}
+
+	// ELSE, INSERTING THE COLUMNS IN A HASH SET
+	else
+	{
+		size_t mask = prepareHash(maxEntries);
+		for (long position = first.rowPtr[i]; position < first.rowPtr[i + 1]; position++)
+		{
+			int j = first.colIdx[position];
+			for (long position2 = second.rowPtr[j]; position2 < second.rowPtr[j + 1]; position2++)
+			{
+				int k = second.colIdx[position2];
+				size_t slot = findSlot(k, mask);
+				if (hashKeys[slot] == -1)
+				{
+					hashKeys[slot] = k;
+					touchedCols.push_back(slot);
+					outCols.push_back(k);
+				}
+			}
+		}
+
+		// CLEARING THE USED SLOTS FOR THE NEXT ROW
+		for (size_t t = 0; t < touchedCols.size(); t++)
+		{
+			hashKeys[touchedCols[t]] = -1;
+		}
+	}
+
+	sort(outCols.begin() + rowFirst, outCols.end());
+}
+
+long ProductRowWorkspace::numericRow(const CSRArrays &first, const CSRArrays &second, int i, const int *structCols, long size,
+									 int *outCols, int *outValues)
+{
+	long written = 0;
+
+	// WITH THE DENSE ACCUMULATOR, THE PRODUCTS ARE SCATTERED BY COLUMN AND GATHERED IN THE ORDER OF THE STRUCTURE
+	if (useDense(size))
+	{
+		allocateDense();
+		touchedCols.clear();
+		for (long position = first.rowPtr[i]; position < first.rowPtr[i + 1]; position++)
+		{
+			int j = first.colIdx[position];
+			int value = first.values[position];
+			for (long position2 = second.rowPtr[j]; position2 < second.rowPtr[j + 1]; position2++)
+			{
+				int k = second.colIdx[position2];
+				if (lastRow[k] != i)
+				{
+					lastRow[k] = i;
+					touchedCols.push_back(k);
+				}
+				accumulator[k] += value * second.values[position2];
+			}
+		}
+
+		// EVERY TOUCHED COLUMN MUST BE ONE OF THE COLUMNS OF THE STRUCTURE
+		long matched = 0;
+		for (long t = 0; t < size; t++)
+		{
+			int k = structCols[t];
+			if (lastRow[k] != i)
+			{
+				continue;
+			}
+			matched++;
+			if (accumulator[k] != 0)
+			{
+				outCols[written] = k;
+				outValues[written] = accumulator[k];
+				written++;
+			}
+		}
+		for (size_t t = 0; t < touchedCols.size(); t++)
+		{
+			accumulator[touchedCols[t]] = 0;
+		}
+		return matched == (long)touchedCols.size() ? written : -1;
+	}
+
+	// ELSE, THE COLUMNS OF THE STRUCTURE ARE HASHED TO THEIR POSITIONS,
+	// AND EVERY PRODUCT IS ADDED STRAIGHT INTO THE OUTPUT ROW AT THE POSITION OF ITS COLUMN
+	size_t mask = prepareHash(size);
+	for (long t = 0; t < size; t++)
+	{
+		size_t slot = findSlot(structCols[t], mask);
+		hashKeys[slot] = structCols[t];
+		hashPositions[slot] = t;
+		touchedCols.push_back(slot);
+	}
+	fill(outValues, outValues + size, 0);
+	bool inStructure = true;
+	for (long position = first.rowPtr[i]; position < first.rowPtr[i + 1] && inStructure; position++)
+	{
+		int j = first.colIdx[position];
+		int value = first.values[position];
+		for (long position2 = second.rowPtr[j]; position2 < second.rowPtr[j + 1]; position2++)
+		{
+			size_t slot = findSlot(second.colIdx[position2], mask);
+			if (hashKeys[slot] == -1)
+			{
+				inStructure = false;
+				break;
+			}
+			outValues[hashPositions[slot]] += value * second.values[position2];
+		}
+	}
+
+	// CLEARING THE USED SLOTS FOR THE NEXT ROW
+	for (size_t t = 0; t < touchedCols.size(); t++)
+	{
+		hashKeys[touchedCols[t]] = -1;
+	}
+	if (!inStructure)
+	{
+		return -1;
+	}
+
+	// DROPPING THE COLUMNS WHOSE SUM IS ZERO
+	for (long t = 0; t < size; t++)
+	{
+		if (outValues[t] != 0)
+		{
+			outCols[written] = structCols[t];
+			outValues[written] = outValues[t];
+			written++;
+		}
+	}
+	return written;
+}
+
+// FUNCTION TO BUILD A BALANCED BST FROM THE SORTED CSR ENTRIES first .. last - 1 OF A ROW
+Node *buildTreeFromCSR(NodeArena &arena, int currRow, const int *colIdx, const int *values, long first, long last)
+{
+	if (first >= last)
+	{
+		return NULL;
+	}
+
+	// THE MIDDLE ENTRY BECOMES THE ROOT SO THAT BOTH SUBTREES GET HALF OF THE ENTRIES
+	long middle = first + (last - first) / 2;
+	Node *root = createNode(arena, currRow, colIdx[middle], values[middle]);
+	root->left = buildTreeFromCSR(arena, currRow, colIdx, values, first, middle);
+	root->right = buildTreeFromCSR(arena, currRow, colIdx, values, middle + 1, last);
+	updateHeight(root);
+	return root;
+}
+
+// CONSTRUCTOR TO INITIALIZE THE SPARSE MATRIX WITH THE GIVEN NUMBER OF ROWS AND COLUMNS
+SparseMatrix::SparseMatrix(int numRows, int numCols)
+{
+	// CHECKING IF THE NUMBER OF ROWS AND COLUMNS ARE POSITIVE, NOT EXCEEDING THE MAXIMUM LIMIT AND NOT ZERO
+	if (numRows <= 0 || numCols <= 0)
+	{
+		errorMessage("Number of rows and columns is incorrect!");
+	}
+
+	// SETTING THE NUMBER OF ROWS AND COLUMNS OF THE MATRIX TO THE GIVEN VALUES OF THE PARAMETERS
+	rows = numRows;
+	cols = numCols;
+
+	// CREATING AN ARRAY OF BINARY SEARCH TREES WITH SIZE = NUMBER OF ROWS OF THE MATRIX
+	// TO STORE NON-ZERO ELEMENTS WITH THE SAME ROW NUMBER IN A SORTED ORDER IN THE BINARY SEARCH TREE
+	treesArr = new BSTree[rows];
+
+	// A NEW MATRIX IS NOT FROZEN
+	frozen = false;
+	rowPtr = NULL;
+	colIdx = NULL;
+	values = NULL;
+	mappedFile = NULL;
+	rowScheduler = NULL;
+}
+
+// MAKING A DEEP COPY OF ANOTHER MATRIX, IN THE SAME STORAGE MODE
+SparseMatrix::SparseMatrix(const SparseMatrix &other)
+{
+	rows = other.rows;
+	cols = other.cols;
+	frozen = other.frozen;
+	treesArr = NULL;
+	rowPtr = NULL;
+	colIdx = NULL;
+	values = NULL;
+	mappedFile = NULL;
+	rowScheduler = NULL;
+
+	// COPYING THE CSR ARRAYS OF A FROZEN MATRIX
+	if (frozen)
+	{
+		rowPtr = new long[rows + 1];
+		colIdx = new int[other.rowPtr[rows]];
+		values = new int[other.rowPtr[rows]];
+		copy(other.rowPtr, other.rowPtr + rows + 1, rowPtr);
+		copy(other.colIdx, other.colIdx + other.rowPtr[rows], colIdx);
+		copy(other.values, other.values + other.rowPtr[rows], values);
+		return;
+	}
+
+	// COPYING EVERY ROW TREE NODE BY NODE, WITH ALL THE NODES IN ONE SLAB OF THE NEW ARENA
+	long numNodes = 0;
+	for (int currRow = 0; currRow < rows; currRow++)
+	{
+		numNodes += countNodes(other.treesArr[currRow].root);
+	}
+	arena.reserve(numNodes);
+	treesArr = new BSTree[rows];
+	for (int currRow = 0; currRow < rows; currRow++)
+	{
+		treesArr[currRow].root = copyTree(arena, other.treesArr[currRow].root);
+	}
+}
+
+// TAKING OVER THE STORAGE OF ANOTHER MATRIX WITHOUT COPYING IT
+SparseMatrix::SparseMatrix(SparseMatrix &&other) : arena(std::move(other.arena))
+{
+	rows = other.rows;
+	cols = other.cols;
+	treesArr = other.treesArr;
+	frozen = other.frozen;
+	rowPtr = other.rowPtr;
+	colIdx = other.colIdx;
+	values = other.values;
+	mappedFile = other.mappedFile;
+	rowScheduler = other.rowScheduler;
+
+	// THE OTHER MATRIX IS LEFT EMPTY, SO THAT ITS DESTRUCTOR RELEASES NOTHING
+	other.rows = 0;
+	other.cols = 0;
+	other.treesArr = NULL;
+	other.frozen = false;
+	other.rowPtr = NULL;
+	other.colIdx = NULL;
+	other.values = NULL;
+	other.mappedFile = NULL;
+	other.rowScheduler = NULL;
+}
+
+// RELEASING THE STORAGE OF THE MATRIX AND TAKING OVER THE STORAGE OF ANOTHER ONE
+SparseMatrix &SparseMatrix::operator=(SparseMatrix &&other)
+{
+	if (this == &other)
+	{
+		return *this;
+	}
+
+	delete[] treesArr;
+	releaseCSR();
+	arena = std::move(other.arena);
+
+	rows = other.rows;
+	cols = other.cols;
+	treesArr = other.treesArr;
+	frozen = other.frozen;
+	rowPtr = other.rowPtr;
+	colIdx = other.colIdx;
+	values = other.values;
+	mappedFile = other.mappedFile;
+	rowScheduler = other.rowScheduler;
+
+	other.rows = 0;
+	other.cols = 0;
+	other.treesArr = NULL;
+	other.frozen = false;
+	other.rowPtr = NULL;
+	other.colIdx = NULL;
+	other.values = NULL;
+	other.mappedFile = NULL;
+	other.rowScheduler = NULL;
+	return *this;
+}
+
+// RELEASING THE ROW TREES (THEIR NODES ARE RELEASED WITH THE ARENA) AND THE CSR ARRAYS
+SparseMatrix::~SparseMatrix()
+{
+	delete[] treesArr;
+	releaseCSR();
+}
+
+// RELEASING THE CSR ARRAYS: ARRAYS SERVED FROM A MAPPED FILE ARE RELEASED BY UNMAPPING THE FILE
+void SparseMatrix::releaseCSR()
+{
+	if (mappedFile)
+	{
+		delete mappedFile;
+		mappedFile = NULL;
+	}
+	else
+	{
+		delete[] rowPtr;
+		delete[] colIdx;
+		delete[] values;
+	}
+	rowPtr = NULL;
+	colIdx = NULL;
+	values = NULL;
+
+	// THE SPLIT OF THE ROWS ONLY HOLDS FOR THE ARRAYS IT WAS COMPUTED FOR
+	delete rowScheduler;
+	rowScheduler = NULL;
+}
+
+// CONVERTING THE ROW TREES TO THE CSR ARRAYS
+void SparseMatrix::freeze()
+{
+	if (frozen)
+	{
+		return;
+	}
+
+	// COUNTING THE NON-ZERO ELEMENTS OF EVERY ROW TO FIND WHERE EACH ROW STARTS IN THE CSR ARRAYS
+	rowPtr = new long[rows + 1];
+	rowPtr[0] = 0;
+	for (int currRow = 0; currRow < rows; currRow++)
+	{
+		rowPtr[currRow + 1] = rowPtr[currRow] + countNodes(treesArr[currRow].root);
+	}
+
+	// COPYING THE ELEMENTS OF EVERY ROW IN INCREASING COLUMN ORDER
+	colIdx = new int[rowPtr[rows]];
+	values = new int[rowPtr[rows]];
+	for (int currRow = 0; currRow < rows; currRow++)
+	{
+		long position = rowPtr[currRow];
+		copyToCSR(treesArr[currRow].root, colIdx, values, position);
+	}
+
+	// RELEASING THE ROW TREES, WITH ALL THEIR NODES AT ONCE
+	delete[] treesArr;
+	treesArr = NULL;
+	arena.releaseAll();
+
+	frozen = true;
+}
+
+// STARTING CSR ARRAYS THAT A KERNEL FILLS ROW AFTER ROW
+void SparseMatrix::beginRows(long capacity)
+{
+	delete[] treesArr;
+	treesArr = NULL;
+	arena.releaseAll();
+	releaseCSR();
+
+	rowPtr = new long[rows + 1];
+	rowPtr[0] = 0;
+	colIdx = new int[capacity];
+	values = new int[capacity];
+	frozen = true;
+}
+
+// COPYING ROWS WRITTEN WITH GAPS BETWEEN THEM INTO CSR ARRAYS OF EXACTLY THE RIGHT SIZE
+void SparseMatrix::packRows(const long *rowStarts, const long *rowSizes)
+{
+	for (int currRow = 0; currRow < rows; currRow++)
+	{
+		rowPtr[currRow + 1] = rowPtr[currRow] + rowSizes[currRow];
+	}
+
+	// THE NEW rowPtr IS ALSO THE PREFIX SUM OF THE ELEMENTS TO COPY, WHICH THE SCHEDULER SPLITS INTO CHUNKS
+	int *newColIdx = new int[rowPtr[rows]];
+	int *newValues = new int[rowPtr[rows]];
+	WorkScheduler scheduler(rowPtr, rows, chooseNumWorkers(rowPtr[rows], rows));
+	scheduler.run([&](int worker)
+				  {
+		int chunk;
+		while (scheduler.nextChunk(worker, chunk))
+		{
+			for (int currRow = scheduler.chunkStart(chunk); currRow < scheduler.chunkStart(chunk + 1); currRow++)
+			{
+				copy(colIdx + rowStarts[currRow], colIdx + rowStarts[currRow] + rowSizes[currRow], newColIdx + rowPtr[currRow]);
+				copy(values + rowStarts[currRow], values + rowStarts[currRow] + rowSizes[currRow], newValues + rowPtr[currRow]);
+			}
+		} });
+	delete[] colIdx;
+	delete[] values;
+	colIdx = newColIdx;
+	values = newValues;
+}
+
+// CONVERTING THE CSR ARRAYS BACK TO ROW TREES
+void SparseMatrix::thaw()
+{
+	if (!frozen)
+	{
+		return;
+	}
+
+	// BUILDING A BALANCED TREE FROM THE SORTED ELEMENTS OF EVERY ROW, WITH ALL THE NODES IN ONE SLAB
+	treesArr = new BSTree[rows];
+	arena.reserve(rowPtr[rows]);
+	for (int currRow = 0; currRow < rows; currRow++)
+	{
+		treesArr[currRow].root = buildTreeFromCSR(arena, currRow, colIdx, values, rowPtr[currRow], rowPtr[currRow + 1]);
+	}
+
+	// RELEASING THE CSR ARRAYS
+	releaseCSR();
+
+	frozen = false;
+}
+
+bool SparseMatrix::isFrozen()
+{
+	return frozen;
+}
+
+// SETTING AND ADDING ELEMENT IN THE MATRIX
+int SparseMatrix::setElement(int currRow, int currCol, int value)
+{
+	// CHECKING IF THE ROW AND COLUMN NUMBER IS WITHIN THE RANGE OF THE MATRIX
+	if (currRow < 0 || currRow >= rows || currCol < 0 || currCol >= cols)
+	{
+		errorMessage("Row or column number is out of range");
+	}
+
+	// CHECKING IF THE VALUE IS ZERO, WHICH MEANS THAT THE ELEMENT IS REMOVED IF IT IS STORED
+	if (value == 0)
+	{
+		if (frozen && getElement(currRow, currCol) == 0)
+		{
+			return 1;
+		}
+		thaw();
+		treesArr[currRow].root = removeNode(arena, treesArr[currRow].root, currCol);
+		return 1;
+	}
+
+	// A FROZEN MATRIX CANNOT BE MODIFIED IN PLACE, SO THE ROW TREES ARE REBUILT FIRST
+	thaw();
+
+	// INSERTING OR UPDATING THE ELEMENT IN THE AVL TREE OF THE ROW, WHICH MAY CHANGE THE ROOT OF THE TREE
+	treesArr[currRow].root = insertNode(arena, treesArr[currRow].root, currRow, currCol, value);
+
+	return 1;
+}
+
+// GETTING THE ELEMENT FROM THE MATRIX AT THE GIVEN ROW AND COLUMN
+int SparseMatrix::getElement(int currRow, int currCol)
+{
+	// CHECKING IF THE ROW AND COLUMN NUMBER IS WITHIN THE RANGE OF THE MATRIX
+	if (currRow < 0 || currRow >= rows || currCol < 0 || currCol >= cols)
+	{
+		errorMessage("Row or column number is out of range");
+	}
+
+	// IF THE MATRIX IS FROZEN, BINARY SEARCH THE COLUMN IN THE SORTED CSR ROW
+	if (frozen)
+	{
+		const int *rowStart = colIdx + rowPtr[currRow];
+		const int *rowEnd = colIdx + rowPtr[currRow + 1];
+		const int *found = lower_bound(rowStart, rowEnd, currCol);
+		if (found != rowEnd && *found == currCol)
+		{
+			return values[found - colIdx];
+		}
+		return 0;
+	}
+
+	// CHECKING IF THE BST IS EMPTY
+	if (treesArr[currRow].root == NULL)
+	{
+		return 0;
+	}
+
+	// FINDING THE ELEMENT USING BINARY SEARCH
+	Node *currentNode = treesArr[currRow].root;
+
+	while (currentNode != NULL)
+	{
+		// FOUND THE ELEMENT AT THE CURRENT NODE AND RETURNING THE VALUE OF THE ELEMENT
+		if (currentNode->col == currCol)
+		{
+			return currentNode->value;
+		}
+
+		// CHECKING IF THE ELEMENT IS PRESENT IN THE LEFT SUBTREE OF THE BST
+		else if (currentNode->col > currCol)
+		{
+			currentNode = currentNode->left;
+		}
+
+		// CHECKING IF THE ELEMENT IS PRESENT IN THE RIGHT SUBTREE OF THE BST
+		else
+		{
+			currentNode = currentNode->right;
+		}
+	}
+
+	return 0;
+}
+
+// FUNCTION TO SORT A ROW BY COLUMN IN PLACE IF IT IS NOT SORTED ALREADY, KEEPING ONLY THE LAST OF THE ELEMENTS WITH THE
+// SAME COLUMN AND DROPPING ZEROS. RETURNS THE NUMBER OF ELEMENTS KEPT, WHICH ARE MOVED TO THE START OF THE ROW
+long cleanRow(int *rowCols, int *rowValues, long size, vector<pair<int, int> > &rowEntries)
+{
+	bool sorted = true;
+	for (long position = 1; position < size && sorted; position++)
+	{
+		sorted = rowCols[position - 1] < rowCols[position];
+	}
+
+	long writePosition = 0;
+	if (sorted)
+	{
+		for (long position = 0; position < size; position++)
+		{
+			if (rowValues[position] != 0)
+			{
+				rowCols[writePosition] = rowCols[position];
+				rowValues[writePosition] = rowValues[position];
+				writePosition++;
+			}
+		}
+		return writePosition;
+	}
+
+	rowEntries.clear();
+	for (long position = 0; position < size; position++)
+	{
+		rowEntries.push_back(make_pair(rowCols[position], rowValues[position]));
+	}
+	stable_sort(rowEntries.begin(), rowEntries.end(),
+				[](const pair<int, int> &a, const pair<int, int> &b)
+				{ return a.first < b.first; });
+	for (size_t i = 0; i < rowEntries.size(); i++)
+	{
+		// ONLY THE LAST OF THE ELEMENTS WITH THE SAME COLUMN IS KEPT, AND ONLY IF IT IS NOT ZERO
+		if (i + 1 < rowEntries.size() && rowEntries[i + 1].first == rowEntries[i].first)
+		{
+			continue;
+		}
+		if (rowEntries[i].second == 0)
+		{
+			continue;
+		}
+		rowCols[writePosition] = rowEntries[i].first;
+		rowValues[writePosition] = rowEntries[i].second;
+		writePosition++;
+	}
+	return writePosition;
+}
+
+// CREATING THE MATRIX FROM AN ARRAY OF (ROW, COLUMN, VALUE) TRIPLES
+SparseMatrix::SparseMatrix(int numRows, int numCols, MatrixEntry *entries, long numEntries)
+{
+	// CHECKING IF THE NUMBER OF ROWS AND COLUMNS ARE POSITIVE, NOT EXCEEDING THE MAXIMUM LIMIT AND NOT ZERO
+	if (numRows <= 0 || numCols <= 0)
+	{
+		errorMessage("Number of rows and columns is incorrect!");
+	}
+
+	rows = numRows;
+	cols = numCols;
+	treesArr = NULL;
+	mappedFile = NULL;
+	rowScheduler = NULL;
+
+	// SPLITTING THE ARRAY INTO ONE LIST PER THREAD, SO THAT THE ELEMENTS ARE PLACED IN THEIR ROWS IN PARALLEL
+	int numLists = getNumThreads();
+	vector<const MatrixEntry *> entryLists(numLists);
+	vector<long> listSizes(numLists);
+	for (int list = 0; list < numLists; list++)
+	{
+		long first = numEntries * list / numLists;
+		entryLists[list] = entries + first;
+		listSizes[list] = numEntries * (list + 1) / numLists - first;
+	}
+	buildFromEntries(entryLists.data(), listSizes.data(), numLists);
+}
+
+// BUILDING THE CSR ARRAYS FROM LISTS OF (ROW, COLUMN, VALUE) TRIPLES WITH A PARALLEL COUNTING SORT BY ROW
+void SparseMatrix::buildFromEntries(const MatrixEntry *const *entryLists, const long *listSizes, int numLists)
+{
+	long numEntries = 0;
+	for (int list = 0; list < numLists; list++)
+	{
+		numEntries += listSizes[list];
+	}
+
+	// EVERY WORKER TAKES A RUN OF CONSECUTIVE LISTS AND NEEDS A COUNT FOR EVERY ROW, SO THERE ARE NO MORE
+	// WORKERS THAN THE ELEMENTS CAN PAY FOR: ALL THE COUNTS TOGETHER ARE NOT LARGER THAN THE ELEMENTS
+	int numWorkers = chooseNumWorkers(numEntries, numLists);
+	numWorkers = (int)min((long)numWorkers, max(1L, numEntries / ((long)rows + 1)));
+	auto firstList = [&](int worker)
+	{
+		return (int)((long)numLists * worker / numWorkers);
+	};
+
+	// CHECKING THAT ALL THE ELEMENTS ARE WITHIN THE RANGE OF THE MATRIX AND COUNTING THE ELEMENTS OF EVERY ROW
+	// IN THE LISTS OF EVERY WORKER
+	vector<vector<long> > rowCounts(numWorkers);
+	runInParallel(numWorkers, [&](int worker)
+				  {
+		vector<long> &counts = rowCounts[worker];
+		counts.assign(rows, 0);
+		for (int list = firstList(worker); list < firstList(worker + 1); list++)
+		{
+			const MatrixEntry *entries = entryLists[list];
+			for (long i = 0; i < listSizes[list]; i++)
+			{
+				if (entries[i].row < 0 || entries[i].row >= rows || entries[i].col < 0 || entries[i].col >= cols)
+				{
+					errorMessage("Row or column number is out of range");
+				}
+				counts[entries[i].row]++;
+			}
+		} });
+
+	// TURNING THE COUNTS INTO THE POSITION WHERE EVERY WORKER PLACES THE FIRST ELEMENT IT HAS FOR EVERY ROW:
+	// WITHIN A ROW, THE ELEMENTS OF THE FIRST WORKER COME FIRST, SO THE ORDER OF THE LISTS IS KEPT
+	rowPtr = new long[rows + 1];
+	long total = 0;
+	for (int currRow = 0; currRow < rows; currRow++)
+	{
+		rowPtr[currRow] = total;
+		for (int worker = 0; worker < numWorkers; worker++)
+		{
+			long count = rowCounts[worker][currRow];
+			rowCounts[worker][currRow] = total;
+			total += count;
+		}
+	}
+	rowPtr[rows] = total;
+
+	// PLACING EVERY ELEMENT IN ITS ROW, KEEPING THE INPUT ORDER WITHIN EACH ROW
+	colIdx = new int[total];
+	values = new int[total];
+	runInParallel(numWorkers, [&](int worker)
+				  {
+		vector<long> &nextPosition = rowCounts[worker];
+		for (int list = firstList(worker); list < firstList(worker + 1); list++)
+		{
+			const MatrixEntry *entries = entryLists[list];
+			for (long i = 0; i < listSizes[list]; i++)
+			{
+				long position = nextPosition[entries[i].row]++;
+				colIdx[position] = entries[i].col;
+				values[position] = entries[i].value;
+			}
+		}
+		vector<long>().swap(nextPosition); });
+
+	// SORTING THE ROWS BY COLUMN ONLY WHEN THEY DID NOT ARRIVE SORTED, AND DROPPING REPEATED COLUMNS AND ZEROS.
+	// AS WITH setElement, THE LAST VALUE GIVEN FOR A POSITION IS THE ONE KEPT.
+	// EVERY ROW IS CLEANED IN PLACE, IN CHUNKS OF ROWS WITH ABOUT THE SAME NUMBER OF ELEMENTS
+	vector<long> workPrefix(rows + 1);
+	for (int currRow = 0; currRow <= rows; currRow++)
+	{
+		workPrefix[currRow] = rowPtr[currRow] + currRow;
+	}
+	WorkScheduler scheduler(workPrefix.data(), rows, chooseNumWorkers(total, rows));
+	vector<long> rowSizes(rows);
+	scheduler.run([&](int worker)
+				  {
+		vector<pair<int, int> > rowEntries;
+		int chunk;
+		while (scheduler.nextChunk(worker, chunk))
+		{
+			for (int currRow = scheduler.chunkStart(chunk); currRow < scheduler.chunkStart(chunk + 1); currRow++)
+			{
+				rowSizes[currRow] = cleanRow(colIdx + rowPtr[currRow], values + rowPtr[currRow],
+											 rowPtr[currRow + 1] - rowPtr[currRow], rowEntries);
+			}
+		} });
+
+	// MOVING THE ROWS TOGETHER WHEN ELEMENTS WERE DROPPED
+	frozen = true;
+	long kept = 0;
+	for (int currRow = 0; currRow < rows; currRow++)
+	{
+		kept += rowSizes[currRow];
+	}
+	if (kept != total)
+	{
+		vector<long> rowStarts(rowPtr, rowPtr + rows);
+		packRows(rowStarts.data(), rowSizes.data());
+	}
+}
+
+// READING THE MATRIX FROM THE FILE AND STORING IT
+SparseMatrix::SparseMatrix(char *matrixFilePath)
+{
+	// MAPPING THE WHOLE FILE INTO MEMORY, SO THAT IT IS SCANNED IN PLACE WITHOUT BEING READ LINE BY LINE
+	MappedFile inputFile(matrixFilePath);
+	LogManager::writePrintfToLog(LogManager::Level::Status, "SparseMatrix::SparseMatrix",
+								 "Loading input file: %s", matrixFilePath);
+	treesArr = NULL;
+	mappedFile = NULL;
+	rowScheduler = NULL;
+
+	// A BINARY MATRIX FILE IS NOT SCANNED: THE MATRIX READS ITS ARRAYS STRAIGHT FROM THE MAPPED PAGES
+	if (isBinaryMatrix(inputFile.getData(), inputFile.getSize()))
+	{
+		openBinary(inputFile, matrixFilePath);
+		return;
+	}
+	const char *text = inputFile.getData();
+	const char *textEnd = text + inputFile.getSize();
+
+	// OPENING THE CACHED BINARY FORM OF THE TEXT FILE INSTEAD, IF THE TEXT FILE HAS NOT CHANGED SINCE IT WAS WRITTEN
+	SourceStamp stamp;
+	string cachePath;
+	if (MatrixFileCache::isEnabled())
+	{
+		cachePath = MatrixFileCache::cachePath(matrixFilePath);
+		MappedFile cacheFile;
+		if (MatrixFileCache::lookup(matrixFilePath, text, inputFile.getSize(), stamp, cacheFile))
+		{
+			try
+			{
+				openBinary(cacheFile, cachePath.c_str());
+				return;
+			}
+			catch (const invalid_argument &error)
+			{
+				LogManager::writePrintfToLog(LogManager::Level::Error, "SparseMatrix::SparseMatrix",
+											 "Ignoring cache file %s: %s", cachePath.c_str(), error.what());
+			}
+		}
+	}
+
+	// READING THE FORMAT AND THE NUMBER OF ROWS AND COLUMNS FROM THE HEADER
+	MatrixScanner scanner(text, text, textEnd, matrixFilePath);
+	MatrixFileFormat format = scanner.readHeader();
+	rows = format.rows;
+	cols = format.cols;
+
+	// CUTTING THE ELEMENTS INTO PIECES OF ABOUT THE SAME NUMBER OF BYTES, EACH ENDING RIGHT AFTER A NEWLINE, THAT ARE
+	// SCANNED ON DIFFERENT THREADS WHEN THE FILE IS LARGE ENOUGH
+	const char *body = scanner.getPosition();
+	int numWorkers = chooseNumWorkers(textEnd - body, INT_MAX);
+	int numPieces = (numWorkers == 1) ? 1 : numWorkers * PIECES_PER_WORKER;
+	vector<const char *> pieceStarts(numPieces + 1);
+	vector<long> workPrefix(numPieces + 1);
+	pieceStarts[0] = body;
+	for (int piece = 1; piece < numPieces; piece++)
+	{
+		const char *cut = max(pieceStarts[piece - 1], body + (textEnd - body) / numPieces * piece);
+		cut = find(cut, textEnd, '\n');
+		pieceStarts[piece] = (cut < textEnd) ? cut + 1 : textEnd;
+	}
+	pieceStarts[numPieces] = textEnd;
+	for (int piece = 0; piece <= numPieces; piece++)
+	{
+		workPrefix[piece] = pieceStarts[piece] - body;
+	}
+
+	// EVERY PIECE IS SCANNED INTO ITS OWN LIST, SO THAT THE LISTS KEEP THE ORDER OF THE FILE WHICHEVER THREAD
+	// SCANS THEM. THERE IS AT MOST ONE ELEMENT PER LINE (TWO FOR A SYMMETRIC MATRIX MARKET FILE), SO COUNTING THE
+	// LINES GIVES ENOUGH ROOM FOR ALL OF THEM. AN ERROR IS KEPT WITH ITS PIECE, AND THE ONE CLOSEST TO THE START
+	// OF THE FILE IS REPORTED
+	int entriesPerLine = (format.symmetry == MatrixMarketGeneral) ? 1 : 2;
+	vector<vector<MatrixEntry> > pieceEntries(numPieces);
+	vector<long> pieceLines(numPieces);
+	vector<long> pieceSkipped(numPieces);
+	vector<exception_ptr> pieceErrors(numPieces);
+	WorkScheduler scheduler(workPrefix.data(), numPieces, numWorkers);
+	scheduler.run([&](int worker)
+				  {
+		int chunk;
+		while (scheduler.nextChunk(worker, chunk))
+		{
+			for (int piece = scheduler.chunkStart(chunk); piece < scheduler.chunkStart(chunk + 1); piece++)
+			{
+				try
+				{
+					MatrixScanner pieceScanner(text, pieceStarts[piece], pieceStarts[piece + 1], matrixFilePath);
+					pieceScanner.setFormat(format);
+					pieceEntries[piece].reserve((count(pieceStarts[piece], pieceStarts[piece + 1], '\n') + 1) * entriesPerLine);
+					pieceScanner.readEntries(pieceEntries[piece]);
+					pieceLines[piece] = pieceScanner.getLinesRead();
+					pieceSkipped[piece] = pieceScanner.getSkippedEntries();
+				}
+				catch (...)
+				{
+					pieceErrors[piece] = current_exception();
+				}
+			}
+		} });
+	for (int piece = 0; piece < numPieces; piece++)
+	{
+		if (pieceErrors[piece])
+		{
+			rethrow_exception(pieceErrors[piece]);
+		}
+	}
+
+	// THE SIZE LINE OF A MATRIX MARKET FILE GIVES THE NUMBER OF ELEMENT LINES, WHICH CATCHES A TRUNCATED FILE
+	long linesRead = 0;
+	long skipped = 0;
+	for (int piece = 0; piece < numPieces; piece++)
+	{
+		linesRead += pieceLines[piece];
+		skipped += pieceSkipped[piece];
+	}
+	if (skipped > 0)
+	{
+		LogManager::writePrintfToLog(LogManager::Level::Error, "SparseMatrix::SparseMatrix",
+									 "Skipped %ld elements of %s in column %d, one past the last column", skipped, matrixFilePath, cols);
+	}
+	if (format.matrixMarket && linesRead != format.declaredEntries)
+	{
+		char message[256];
+		snprintf(message, sizeof(message), "%s declares %ld elements but has %ld", matrixFilePath, format.declaredEntries, linesRead);
+		errorMessage(message);
+	}
+
+	// BUILDING THE CSR ARRAYS FROM THE LISTS OF ALL THE PIECES
+	vector<const MatrixEntry *> entryLists(numPieces);
+	vector<long> listSizes(numPieces);
+	for (int piece = 0; piece < numPieces; piece++)
+	{
+		entryLists[piece] = pieceEntries[piece].data();
+		listSizes[piece] = pieceEntries[piece].size();
+	}
+	buildFromEntries(entryLists.data(), listSizes.data(), numPieces);
+
+	// WRITING THE CACHED BINARY FORM FOR THE NEXT LOAD. A CACHE FILE THAT CANNOT BE WRITTEN ONLY MEANS THE NEXT LOAD PARSES AGAIN
+	size_t cacheFileSize = binaryMatrixSize(rows, rowPtr[rows], sizeof(BinaryMatrixHeader) + sizeof(SourceStamp));
+	if (MatrixFileCache::isEnabled() && MatrixFileCache::admits(cacheFileSize))
+	{
+		try
+		{
+			MatrixFileCache::prepare();
+			writeBinary(cachePath.c_str(), &stamp, sizeof(stamp));
+			MatrixFileCache::trim(cachePath);
+		}
+		catch (const ios_base::failure &error)
+		{
+			LogManager::writePrintfToLog(LogManager::Level::Error, "SparseMatrix::SparseMatrix",
+										 "Cannot write cache file %s: %s", cachePath.c_str(), error.what());
+		}
+	}
+}
+
+void SparseMatrix::openBinary(MappedFile &file, const char *filePath)
+{
+	if (sizeof(long) != sizeof(long long))
+	{
+		errorMessage("Binary matrix files need 64-bit row offsets");
+	}
+	BinaryMatrixHeader header = readBinaryMatrixHeader(file.getData(), file.getSize(), filePath);
+
+	// THE ARRAYS FOLLOW THE HEADER ONE AFTER THE OTHER. THE MAPPING STARTS ON A PAGE AND THE HEADER SIZE IS A
+	// MULTIPLE OF 8, SO rowPtr IS ALIGNED, AND colIdx AND values FOLLOW 8-BYTE OFFSETS
+	const long *fileRowPtr = (const long *)(file.getData() + header.headerSize);
+	const int *fileColIdx = (const int *)(fileRowPtr + header.rows + 1);
+	const int *fileValues = fileColIdx + header.nnz;
+	checkBinaryMatrixArrays(fileRowPtr, fileColIdx, fileValues, header, filePath);
+
+	// THE MAPPING IS READ-ONLY, WHICH IS SAFE BECAUSE A FROZEN MATRIX NEVER WRITES INTO ITS CSR ARRAYS:
+	// setElement THAWS IT INTO ROW TREES FIRST, WHICH RELEASES THE MAPPING
+	rows = (int)header.rows;
+	cols = (int)header.cols;
+	rowPtr = const_cast<long *>(fileRowPtr);
+	colIdx = const_cast<int *>(fileColIdx);
+	values = const_cast<int *>(fileValues);
+	mappedFile = new MappedFile(std::move(file));
+	frozen = true;
+}
+
+void SparseMatrix::writeBinaryFile(char *outputFileName)
+{
+	writeBinary(outputFileName, NULL, 0);
+}
+
+void SparseMatrix::writeBinary(const char *outputFileName, const void *extraHeader, size_t extraSize)
+{
+	if (sizeof(long) != sizeof(long long))
+	{
+		errorMessage("Binary matrix files need 64-bit row offsets");
+	}
+
+	// THE FILE IS WRITTEN STRAIGHT FROM THE CSR ARRAYS
+	freeze();
+	BinaryMatrixHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BINARY_MATRIX_MAGIC, sizeof(header.magic));
+	header.version = BINARY_MATRIX_VERSION;
+	header.headerSize = sizeof(header) + extraSize;
+	header.rows = rows;
+	header.cols = cols;
+	header.nnz = rowPtr[rows];
+	header.checksum = binaryMatrixChecksum(rowPtr, rows, colIdx, values);
+
+	// WRITING TO A TEMPORARY FILE THAT IS RENAMED AT THE END, SO THAT A READER NEVER SEES A HALF-WRITTEN FILE
+	// AND A MATRIX OPENED FROM THE SAME PATH KEEPS ITS MAPPING
+	string temporaryName = string(outputFileName) + ".tmp";
+	int fileDescriptor = open(temporaryName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fileDescriptor < 0)
+	{
+		throw ios_base::failure("Cannot open output file for writing");
+	}
+	LogManager::writePrintfToLog(LogManager::Level::Status, "SparseMatrix::writeBinaryFile",
+								 "Writing matrix to binary file: %s", outputFileName);
+
+	bool written = writeAll(fileDescriptor, &header, sizeof(header)) &&
+				   writeAll(fileDescriptor, extraHeader, extraSize) &&
+				   writeAll(fileDescriptor, rowPtr, (rows + 1) * sizeof(long)) &&
+				   writeAll(fileDescriptor, colIdx, rowPtr[rows] * sizeof(int)) &&
+				   writeAll(fileDescriptor, values, rowPtr[rows] * sizeof(int));
+	if (close(fileDescriptor) != 0 || !written || rename(temporaryName.c_str(), outputFileName) != 0)
+	{
+		unlink(temporaryName.c_str());
+		throw ios_base::failure("Cannot write to output file");
+	}
+}
+
+void SparseMatrix::printInParallel(char *outputFileName)
+{
+	int fileDescriptor = open(outputFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fileDescriptor < 0)
+	{
+		throw ios_base::failure("Cannot open output file for writing");
+	}
+	LogManager::writePrintfToLog(LogManager::Level::Status, "SparseMatrix::printToASCIIFile",
+								 "Writing matrix to file: %s", outputFileName);
+
+	char header[2 * (5 + MAX_INT_LENGTH + 1)];
+	long headerLength = writeHeader(header, rows, cols) - header;
+
+	// COUNTING THE CHARACTERS OF EVERY ROW, IN CHUNKS OF ROWS WITH ABOUT THE SAME NUMBER OF ELEMENTS, AND ADDING
+	// THEM UP INTO THE POSITION OF EVERY ROW IN THE FILE
+	vector<long> workPrefix(rows + 1);
+	for (int currRow = 0; currRow <= rows; currRow++)
+	{
+		workPrefix[currRow] = rowPtr[currRow] + currRow;
+	}
+	int numWorkers = chooseNumWorkers(rowPtr[rows], rows);
+	vector<long> rowOffsets(rows + 1);
+	rowOffsets[0] = headerLength;
+	WorkScheduler lengthScheduler(workPrefix.data(), rows, numWorkers);
+	lengthScheduler.run([&](int worker)
+						{
+		int chunk;
+		while (lengthScheduler.nextChunk(worker, chunk))
+		{
+			for (int currRow = lengthScheduler.chunkStart(chunk); currRow < lengthScheduler.chunkStart(chunk + 1); currRow++)
+			{
+				long lineLength = LINE_PUNCTUATION_LENGTH + intLength(currRow);
+				long length = 0;
+				for (long entry = rowPtr[currRow]; entry < rowPtr[currRow + 1]; entry++)
+				{
+					length += lineLength + intLength(colIdx[entry]) + intLength(values[entry]);
+				}
+				rowOffsets[currRow + 1] = length;
+			}
+		} });
+	for (int currRow = 0; currRow < rows; currRow++)
+	{
+		rowOffsets[currRow + 1] += rowOffsets[currRow];
+	}
+
+	// FORMATTING THE CHUNKS OF ROWS IN A BUFFER PER WORKER, WHICH IS WRITTEN AT ITS PLACE IN THE FILE EVERY TIME
+	// IT IS NEARLY FULL. THE CHUNKS CAN BE WRITTEN IN ANY ORDER SINCE THEIR POSITIONS ARE KNOWN
+	atomic<bool> writeFailed(false);
+	WorkScheduler writeScheduler(workPrefix.data(), rows, numWorkers);
+	writeScheduler.run([&](int worker)
+					   {
+		vector<char> buffer(OUTPUT_BUFFER_SIZE);
+		char *limit = buffer.data() + OUTPUT_BUFFER_SIZE - MAX_LINE_LENGTH;
+		int chunk;
+		while (!writeFailed && writeScheduler.nextChunk(worker, chunk))
+		{
+			long fileOffset = rowOffsets[writeScheduler.chunkStart(chunk)];
+			char *position = buffer.data();
+			for (int currRow = writeScheduler.chunkStart(chunk); currRow < writeScheduler.chunkStart(chunk + 1); currRow++)
+			{
+				for (long entry = rowPtr[currRow]; entry < rowPtr[currRow + 1]; entry++)
+				{
+					position = writeEntry(position, currRow, colIdx[entry], values[entry]);
+					if (position > limit)
+					{
+						if (!writeAllAt(fileDescriptor, buffer.data(), position - buffer.data(), fileOffset))
+						{
+							writeFailed = true;
+						}
+						fileOffset += position - buffer.data();
+						position = buffer.data();
+					}
+				}
+			}
+			if (!writeAllAt(fileDescriptor, buffer.data(), position - buffer.data(), fileOffset))
+			{
+				writeFailed = true;
+			}
+		} });
+
+	if (!writeAllAt(fileDescriptor, header, headerLength, 0))
+	{
+		writeFailed = true;
+	}
+	if (close(fileDescriptor) != 0 || writeFailed)
+	{
+		throw ios_base::failure("Cannot write to output file");
+	}
+}
+
+void SparseMatrix::printToASCIIFile(char *outputFileName)
+{
+	// A LARGE FROZEN MATRIX IS FORMATTED ON SEVERAL THREADS
+	if (frozen && chooseNumWorkers(rowPtr[rows], rows) > 1)
+	{
+		printInParallel(outputFileName);
+		return;
+	}
+
+	FILE *outFileStream = fopen(outputFileName, "w");
+	if (!outFileStream)
+	{
+		char *message = new char[2048];
+		sprintf(message, "Cannot open output file for writing");
+		throw ios_base::failure(message);
+		delete[] message;
+	}
+	LogManager::writePrintfToLog(LogManager::Level::Status, "SparseMatrix::printToASCIIFile",
+								 "Writing matrix to file: %s", outputFileName);
+
+	// THE LINES ARE FORMATTED IN A LARGE BUFFER THAT IS WRITTEN TO THE FILE EVERY TIME IT IS NEARLY FULL
+	char *buffer = new char[OUTPUT_BUFFER_SIZE];
+	char *limit = buffer + OUTPUT_BUFFER_SIZE - MAX_LINE_LENGTH;
+	char *position = buffer;
+	bool writeFailed = false;
+
+	position = writeHeader(position, rows, cols);
+
+	// ONLY THE STORED ELEMENTS ARE VISITED, ROW BY ROW IN COLUMN ORDER
+	vector<Node *> stack;
+	for (int currRow = 0; currRow < rows && !writeFailed; currRow++)
+	{
+		// IF THE MATRIX IS FROZEN, THE ROW IS READ SEQUENTIALLY FROM THE CSR ARRAYS
+		if (frozen)
+		{
+			for (long entry = rowPtr[currRow]; entry < rowPtr[currRow + 1]; entry++)
+			{
+				position = writeEntry(position, currRow, colIdx[entry], values[entry]);
+				if (position > limit)
+				{
+					writeFailed = !flushBuffer(outFileStream, buffer, position);
+					position = buffer;
+				}
+			}
+			continue;
+		}
+
+		// ELSE, THE ROW TREE IS WALKED IN ORDER WITH AN EXPLICIT STACK OF THE NODES WHOSE RIGHT SUBTREE IS STILL TO BE VISITED
+		Node *currentNode = treesArr[currRow].root;
+		while (currentNode != NULL || !stack.empty())
+		{
+			while (currentNode != NULL)
+			{
+				stack.push_back(currentNode);
+				currentNode = currentNode->left;
+			}
+			currentNode = stack.back();
+			stack.pop_back();
+
+			position = writeEntry(position, currRow, currentNode->col, currentNode->value);
+			if (position > limit)
+			{
+				writeFailed = !flushBuffer(outFileStream, buffer, position);
+				position = buffer;
+			}
+
+			currentNode = currentNode->right;
+		}
+	}
+
+	if (!writeFailed)
+	{
+		writeFailed = !flushBuffer(outFileStream, buffer, position);
+	}
+	delete[] buffer;
+	if (fclose(outFileStream) != 0 || writeFailed)
+	{
+		throw ios_base::failure("Cannot write to output file");
+	}
+}
+
+void SparseMatrix::writeMatrixMarketFile(char *outputFileName)
+{
+	freeze();
+	FILE *outFileStream = fopen(outputFileName, "w");
+	if (!outFileStream)
+	{
+		throw ios_base::failure("Cannot open output file for writing");
+	}
+	LogManager::writePrintfToLog(LogManager::Level::Status, "SparseMatrix::writeMatrixMarketFile",
+								 "Writing matrix to file: %s", outputFileName);
+
+	char *buffer = new char[OUTPUT_BUFFER_SIZE];
+	char *limit = buffer + OUTPUT_BUFFER_SIZE - MAX_LINE_LENGTH;
+	char *position = buffer;
+	bool writeFailed = false;
+
+	// THE BANNER AND THE SIZE LINE: <rows> <cols> <number of element lines>
+	const char banner[] = "%%MatrixMarket matrix coordinate integer general\n";
+	memcpy(position, banner, sizeof(banner) - 1);
+	position += sizeof(banner) - 1;
+	position += sprintf(position, "%d %d %ld\n", rows, cols, rowPtr[rows]);
+
+	for (int currRow = 0; currRow < rows && !writeFailed; currRow++)
+	{
+		for (long entry = rowPtr[currRow]; entry < rowPtr[currRow + 1]; entry++)
+		{
+			position = writeMatrixMarketEntry(position, currRow, colIdx[entry], values[entry]);
+			if (position > limit)
+			{
+				writeFailed = !flushBuffer(outFileStream, buffer, position);
+				position = buffer;
+			}
+		}
+	}
+
+	if (!writeFailed)
+	{
+		writeFailed = !flushBuffer(outFileStream, buffer, position);
+	}
+	delete[] buffer;
+	if (fclose(outFileStream) != 0 || writeFailed)
+	{
+		throw ios_base::failure("Cannot write to output file");
+	}
+}
+
+// ADDING THE TWO MATRICES AND RETURNING THE RESULT
+SparseMatrix SparseMatrix::operator+(SparseMatrix &inputObject)
+{
+	if (rows != inputObject.rows) // CHECKING IF THE NUMBER OF ROWS ARE EQUAL
+	{
+		char *message = new char[2048];
+		sprintf(message, "Number of rows are not same");
+		throw invalid_argument(message);
+		delete[] message;
+	}
+
+	if (cols != inputObject.cols) // CHECKING IF THE NUMBER OF COLUMNS ARE EQUAL
+	{
+		char *message = new char[2048];
+		sprintf(message, "Number of cols are not same");
+		throw invalid_argument(message);
+		delete[] message;
+	}
+
+	// ADDING THE TWO MATRICES BY MERGING THEIR ROWS
+	return mergeMatrices(inputObject, 1);
+}
+
+// SUBTRACTING THE TWO MATRICES AND STORING THE RESULT IN THE RESULT MATRIX OBJECT CREATED
+SparseMatrix SparseMatrix::operator-(SparseMatrix &inputObject)
+{
+	if (inputObject.rows != rows) // CHECKING IF THE NUMBER OF ROWS ARE EQUAL
+	{
+		char *message = new char[2048];
+		sprintf(message, "Number of rows are not same");
+		throw invalid_argument(message);
+		delete[] message;
+	}
+
+	if (inputObject.cols != cols) // CHECKING IF THE NUMBER OF COLUMNS ARE EQUAL
+	{
+		char *message = new char[2048];
+		sprintf(message, "Number of cols are not same");
+		throw invalid_argument(message);
+		delete[] message;
+	}
+
+	// SUBTRACTING THE TWO MATRICES BY MERGING THEIR ROWS
+	return mergeMatrices(inputObject, -1);
+}
+
+// ADDING OR SUBTRACTING THE TWO MATRICES ROW BY ROW
+SparseMatrix SparseMatrix::mergeMatrices(SparseMatrix &inputObject, int sign)
+{
+	// READING BOTH MATRICES FROM THEIR CSR ARRAYS
+	freeze();
+	inputObject.freeze();
+
+	// CREATING THE RESULT MATRIX OBJECT TO STORE THE RESULT OF THE ADDITION OR SUBTRACTION OF THE TWO MATRICES.
+	// ROW r OF THE RESULT HAS AT MOST AS MANY ELEMENTS AS ROW r OF BOTH MATRICES TOGETHER, SO IT IS WRITTEN AT
+	// POSITION rowPtr[r] + inputObject.rowPtr[r] AND ROWS CANNOT OVERLAP
+	long maxEntries = rowPtr[rows] + inputObject.rowPtr[rows];
+	SparseMatrix resultMat(rows, cols);
+	resultMat.beginRows(maxEntries);
+
+	// THE ROWS ARE SPLIT IN CHUNKS HOLDING ABOUT THE SAME NUMBER OF ELEMENTS OF BOTH MATRICES (PLUS ONE PER ROW,
+	// SO THAT LONG RUNS OF EMPTY ROWS ALSO COUNT), WHICH ARE MERGED ON DIFFERENT THREADS WHEN THE MATRICES ARE
+	// LARGE ENOUGH. EVERY WORKER WRITES ONLY THE RESULT ROWS OF THE CHUNKS IT TAKES
+	vector<long> workPrefix(rows + 1);
+	for (int currRow = 0; currRow <= rows; currRow++)
+	{
+		workPrefix[currRow] = rowPtr[currRow] + inputObject.rowPtr[currRow] + currRow;
+	}
+	WorkScheduler scheduler(workPrefix.data(), rows, chooseNumWorkers(maxEntries, rows));
+	vector<long> rowStarts(rows);
+	vector<long> rowSizes(rows);
+	scheduler.run([&](int worker)
+				  {
+		int chunk;
+		while (scheduler.nextChunk(worker, chunk))
+		{
+			for (int currRow = scheduler.chunkStart(chunk); currRow < scheduler.chunkStart(chunk + 1); currRow++)
+			{
+				long first1 = rowPtr[currRow];
+				long first2 = inputObject.rowPtr[currRow];
+				rowStarts[currRow] = first1 + first2;
+
+				// MERGING THE TWO SORTED ROWS STRAIGHT INTO THE RESULT ROW
+				rowSizes[currRow] = mergeRows(colIdx + first1, values + first1, rowPtr[currRow + 1] - first1,
+											  inputObject.colIdx + first2, inputObject.values + first2, inputObject.rowPtr[currRow + 1] - first2, sign,
+											  resultMat.colIdx + rowStarts[currRow], resultMat.values + rowStarts[currRow]);
+			}
+		} });
+
+	// RETURN THE RESULT MATRIX IN ITS CSR FORM, WITH THE ROWS MOVED TOGETHER
+	resultMat.packRows(rowStarts.data(), rowSizes.data());
 	return resultMat;
 }
 
-// MULTIPLYING THE TWO MATRICES AND STORING THE RESULT IN THE RESULT MATRIX OBJECT CREATED
-SparseMatrix SparseMatrix::operator*(SparseMatrix &inputObject)
+void SparseMatrix::addFiles(char *inputFileName1, char *inputFileName2, char *outputFileName, bool matrixMarketOutput)
+{
+	mergeFiles(inputFileName1, inputFileName2, outputFileName, 1, matrixMarketOutput);
+}
+
+void SparseMatrix::subtractFiles(char *inputFileName1, char *inputFileName2, char *outputFileName, bool matrixMarketOutput)
+{
+	mergeFiles(inputFileName1, inputFileName2, outputFileName, -1, matrixMarketOutput);
+}
+
+// ADDING OR SUBTRACTING TWO MATRIX FILES ROW BY ROW, WITHOUT LOADING EITHER OF THEM
+void SparseMatrix::mergeFiles(char *inputFileName1, char *inputFileName2, char *outputFileName, int sign, bool matrixMarketOutput)
+{
+	MatrixRowReader reader1(inputFileName1);
+	MatrixRowReader reader2(inputFileName2);
+	if (reader1.getRows() != reader2.getRows())
+	{
+		errorMessage("Number of rows are not same");
+	}
+	if (reader1.getCols() != reader2.getCols())
+	{
+		errorMessage("Number of cols are not same");
+	}
+	LogManager::writePrintfToLog(LogManager::Level::Status, "SparseMatrix::mergeFiles",
+								 "Streaming %s and %s to file: %s", inputFileName1, inputFileName2, outputFileName);
+
+	// ONLY ONE ROW OF EACH FILE AND ONE ROW OF THE RESULT ARE HELD AT A TIME, SO THE MEMORY USED IS BOUNDED BY THE LONGEST ROW
+	RowStreamWriter writer(outputFileName, reader1.getRows(), reader1.getCols(), matrixMarketOutput);
+	vector<int> cols1, values1, cols2, values2, outCols, outValues;
+	vector<pair<int, int> > rowEntries;
+	for (int currRow = 0; currRow < reader1.getRows(); currRow++)
+	{
+		// THE COLUMNS OF A ROW CAN COME IN ANY ORDER IN A TEXT FILE, AND THE LAST VALUE GIVEN FOR A POSITION IS KEPT, AS WHEN LOADING
+		reader1.readRow(cols1, values1);
+		reader2.readRow(cols2, values2);
+		long size1 = cleanRow(cols1.data(), values1.data(), cols1.size(), rowEntries);
+		long size2 = cleanRow(cols2.data(), values2.data(), cols2.size(), rowEntries);
+
+		outCols.resize(size1 + size2);
+		outValues.resize(size1 + size2);
+		long size = mergeRows(cols1.data(), values1.data(), size1, cols2.data(), values2.data(), size2, sign,
+							  outCols.data(), outValues.data());
+		writer.writeRow(currRow, outCols.data(), outValues.data(), size);
+	}
+	writer.close();
+}
+
+// CHECKING THAT THE TWO MATRICES CAN BE MULTIPLIED
+void SparseMatrix::checkProductDimensions(SparseMatrix &inputObject)
 {
 	if (inputObject.rows != cols) // CHECKING IF ROWS IN THE SECOND MATRIX IS EQUAL TO COLUMNS IN THE FIRST MATRIX
 	{
@@ -431,57 +2034,707 @@ SparseMatrix SparseMatrix::operator*(SparseMatrix &inputObject)
 		throw invalid_argument(message);
 		delete[] message;
 	}
+}
+
+// FINDING THE POSITIONS OF THE NON-ZERO ELEMENTS OF THE PRODUCT OF THE TWO MATRICES
+ProductStructure SparseMatrix::multiplySymbolic(SparseMatrix &inputObject)
+{
+	checkProductDimensions(inputObject);
+
+	// READING BOTH MATRICES FROM THEIR CSR ARRAYS
+	freeze();
+	inputObject.freeze();
+	CSRArrays first = {rowPtr, colIdx, values};
+	CSRArrays second = {inputObject.rowPtr, inputObject.colIdx, inputObject.values};
+
+	// THE ROWS ARE SPLIT IN CHUNKS WITH ABOUT THE SAME NUMBER OF PRODUCTS TO COMPUTE, WHICH ARE PROCESSED ON
+	// DIFFERENT THREADS WHEN THERE ARE ENOUGH PRODUCTS
+	vector<long> workPrefix = productWorkPrefix(first, second, rows);
+	WorkScheduler scheduler(workPrefix.data(), rows, chooseNumWorkers(workPrefix[rows] - rows, rows));
+
+	// EVERY CHUNK GETS ITS OWN LIST FOR THE SORTED COLUMNS OF ITS ROWS, AND THE NUMBER OF COLUMNS OF EACH ROW IS KEPT
+	ProductStructure structure;
+	structure.rows = rows;
+	structure.cols = inputObject.cols;
+	structure.rowPtr.assign(rows + 1, 0);
+	int numChunks = scheduler.getNumChunks();
+	vector<vector<int> > chunkCols(numChunks);
+	scheduler.run([&](int worker)
+				  {
+		ProductRowWorkspace workspace(inputObject.cols);
+		int chunk;
+		while (scheduler.nextChunk(worker, chunk))
+		{
+			for (int i = scheduler.chunkStart(chunk); i < scheduler.chunkStart(chunk + 1); i++)
+			{
+				size_t rowFirst = chunkCols[chunk].size();
+				workspace.symbolicRow(first, second, i, chunkCols[chunk]);
+				structure.rowPtr[i + 1] = chunkCols[chunk].size() - rowFirst;
+			}
+		} });
+
+	// STITCHING THE LISTS OF THE CHUNKS TOGETHER AFTER COMPUTING WHERE EACH ROW STARTS. THE CHUNKS ARE SPLIT
+	// AGAIN BY THE NUMBER OF COLUMNS TO COPY
+	for (int i = 0; i < rows; i++)
+	{
+		structure.rowPtr[i + 1] += structure.rowPtr[i];
+	}
+	structure.colIdx.resize(structure.rowPtr[rows]);
+	vector<long> chunkFirst(numChunks + 1);
+	for (int chunk = 0; chunk <= numChunks; chunk++)
+	{
+		chunkFirst[chunk] = structure.rowPtr[scheduler.chunkStart(chunk)];
+	}
+	WorkScheduler copyScheduler(chunkFirst.data(), numChunks, chooseNumWorkers(structure.rowPtr[rows], numChunks));
+	copyScheduler.run([&](int worker)
+					  {
+		int copyChunk;
+		while (copyScheduler.nextChunk(worker, copyChunk))
+		{
+			for (int chunk = copyScheduler.chunkStart(copyChunk); chunk < copyScheduler.chunkStart(copyChunk + 1); chunk++)
+			{
+				copy(chunkCols[chunk].begin(), chunkCols[chunk].end(), structure.colIdx.begin() + chunkFirst[chunk]);
+				vector<int>().swap(chunkCols[chunk]);
+			}
+		} });
+	return structure;
+}
+
+// COMPUTING THE VALUES OF THE PRODUCT OF THE TWO MATRICES AT THE POSITIONS GIVEN BY ITS STRUCTURE
+SparseMatrix SparseMatrix::multiplyNumeric(SparseMatrix &inputObject, const ProductStructure &structure)
+{
+	checkProductDimensions(inputObject);
+	if (structure.rows != rows || structure.cols != inputObject.cols)
+	{
+		errorMessage("Product structure does not have the dimensions of the product");
+	}
+
+	// READING BOTH MATRICES FROM THEIR CSR ARRAYS
+	freeze();
+	inputObject.freeze();
+	CSRArrays first = {rowPtr, colIdx, values};
+	CSRArrays second = {inputObject.rowPtr, inputObject.colIdx, inputObject.values};
+
+	// CREATING THE RESULT MATRIX WITH EXACTLY AS MUCH ROOM AS THE STRUCTURE HAS ELEMENTS
+	SparseMatrix resultMat(rows, inputObject.cols);
+	resultMat.beginRows(structure.rowPtr[rows]);
+
+	// THE ROWS ARE SPLIT IN CHUNKS WITH ABOUT THE SAME NUMBER OF PRODUCTS TO COMPUTE
+	vector<long> workPrefix = productWorkPrefix(first, second, rows);
+	WorkScheduler scheduler(workPrefix.data(), rows, chooseNumWorkers(workPrefix[rows] - rows, rows));
+
+	// COMPUTING THE RESULT ROW BY ROW (GUSTAVSON'S ALGORITHM): ROW i OF THE RESULT IS THE SUM OF THE ROWS j OF THE
+	// SECOND MATRIX, EACH SCALED BY THE ELEMENT (i, j) OF THE FIRST MATRIX.
+	// EVERY WORKER HAS ITS OWN ACCUMULATORS AND WRITES ITS ROWS AT THEIR POSITIONS IN THE STRUCTURE, SO NO LOCK IS NEEDED
+	vector<long> rowSizes(rows);
+	scheduler.run([&](int worker)
+				  {
+		ProductRowWorkspace workspace(inputObject.cols);
+		int chunk;
+		while (scheduler.nextChunk(worker, chunk))
+		{
+			for (int i = scheduler.chunkStart(chunk); i < scheduler.chunkStart(chunk + 1); i++)
+			{
+				long outFirst = structure.rowPtr[i];
+				rowSizes[i] = workspace.numericRow(first, second, i, structure.colIdx.data() + outFirst,
+												   structure.rowPtr[i + 1] - outFirst,
+												   resultMat.colIdx + outFirst, resultMat.values + outFirst);
+				if (rowSizes[i] < 0)
+				{
+					errorMessage("Product structure does not match the sparsity patterns of the matrices");
+				}
+			}
+		} });
+
+	// SUMS THAT ARE ZERO WERE DROPPED, IN WHICH CASE THE ROWS ARE MOVED TOGETHER INTO SMALLER ARRAYS
+	long written = 0;
+	for (int i = 0; i < rows; i++)
+	{
+		written += rowSizes[i];
+	}
+	if (written != structure.rowPtr[rows])
+	{
+		resultMat.packRows(structure.rowPtr.data(), rowSizes.data());
+	}
+	else
+	{
+		copy(structure.rowPtr.begin(), structure.rowPtr.end(), resultMat.rowPtr);
+	}
+	return resultMat;
+}
 
+// MULTIPLYING THE TWO MATRICES AND STORING THE RESULT IN THE RESULT MATRIX OBJECT CREATED
+SparseMatrix SparseMatrix::operator*(SparseMatrix &inputObject)
+{
 	/**
 	 * In matrix multiplication, number of rows in the result is equal to number of rows in first matrix.
 	 * number of cols in the result is equal to number of cols in first matrix.
 	 */
 
-	// CREATING THE RESULT MATRIX OBJECT TO STORE THE RESULT OF MULTIPLICATION OF THE TWO MATRICES
-	SparseMatrix resultMat(rows, inputObject.cols);
-	int nbr;
+	// FINDING THE STRUCTURE OF THE RESULT FIRST, THEN ITS VALUES
+	ProductStructure structure = multiplySymbolic(inputObject);
+	return multiplyNumeric(inputObject, structure);
+}
 
-	// ITERATING OVER THE NON-ZERO ELEMENTS OF THE FIRST MATRIX
-	for (int i = 0; i < rows; i++)
+// NUMBER OF ELEMENTS AHEAD WHOSE PLACES IN THE RESULT ARE PREFETCHED BY transpose
+const long TRANSPOSE_PREFETCH_DISTANCE = 32;
+
+// TRANSPOSING THE MATRIX WITH A PARALLEL COUNTING SORT OF ITS ELEMENTS BY COLUMN
+SparseMatrix SparseMatrix::transpose()
+{
+	freeze();
+	long total = rowPtr[rows];
+	SparseMatrix resultMat(cols, rows);
+	resultMat.beginRows(total);
+
+	// EVERY WORKER TAKES A RANGE OF ROWS WITH ABOUT THE SAME NUMBER OF ELEMENTS AND NEEDS A COUNT FOR EVERY
+	// COLUMN, SO THERE ARE NO MORE WORKERS THAN THE ELEMENTS CAN PAY FOR, AS IN buildFromEntries
+	int numWorkers = chooseNumWorkers(total, rows);
+	numWorkers = (int)min((long)numWorkers, max(1L, total / ((long)cols + 1)));
+	vector<int> firstRows(numWorkers + 1);
+	for (int worker = 0; worker < numWorkers; worker++)
 	{
-		Node *currentNode = treesArr[i].root;
+		firstRows[worker] = (int)(lower_bound(rowPtr, rowPtr + rows, total * worker / numWorkers) - rowPtr);
+	}
+	firstRows[numWorkers] = rows;
+
+	// COUNTING THE ELEMENTS OF EVERY COLUMN IN THE ROWS OF EVERY WORKER
+	vector<vector<long> > colCounts(numWorkers);
+	runInParallel(numWorkers, [&](int worker)
+				  {
+		vector<long> &counts = colCounts[worker];
+		counts.assign(cols, 0);
+		for (long entry = rowPtr[firstRows[worker]]; entry < rowPtr[firstRows[worker + 1]]; entry++)
+		{
+			counts[colIdx[entry]]++;
+		} });
 
-		// ITERATING OVER THE NON-ZERO ELEMENTS OF THE FIRST MATRIX ROW BY ROW
-		while (currentNode != NULL)
+	// TURNING THE COUNTS INTO THE POSITION WHERE EVERY WORKER PLACES THE FIRST ELEMENT IT HAS FOR EVERY COLUMN:
+	// WITHIN A COLUMN, THE ELEMENTS OF THE FIRST WORKER COME FIRST
+	long position = 0;
+	for (int currCol = 0; currCol < cols; currCol++)
+	{
+		resultMat.rowPtr[currCol] = position;
+		for (int worker = 0; worker < numWorkers; worker++)
 		{
-			// COL OF THE CURRENT NODE OF THE FIRST MATRIX
-			int j = currentNode->col;
+			long count = colCounts[worker][currCol];
+			colCounts[worker][currCol] = position;
+			position += count;
+		}
+	}
+	resultMat.rowPtr[cols] = position;
+
+	// PLACING EVERY ELEMENT IN THE ROW OF ITS COLUMN. THE WORKERS TAKE THEIR ROWS IN INCREASING ORDER, SO THE ROWS
+	// OF THE RESULT COME OUT SORTED BY COLUMN WITHOUT ANY SORT.
+	// THE WRITES LAND ALL OVER THE RESULT AND EACH ONE WOULD WAIT FOR A CACHE MISS, SO THE POSITIONS OF THE ELEMENTS
+	// A LITTLE AHEAD ARE PREFETCHED: THEIR COUNTERS FIRST, AND THEIR PLACES IN THE RESULT ONCE THE COUNTERS ARE IN CACHE
+	runInParallel(numWorkers, [&](int worker)
+				  {
+		vector<long> &nextPosition = colCounts[worker];
+		long lastEntry = rowPtr[firstRows[worker + 1]];
+		for (int currRow = firstRows[worker]; currRow < firstRows[worker + 1]; currRow++)
+		{
+			for (long entry = rowPtr[currRow]; entry < rowPtr[currRow + 1]; entry++)
+			{
+				if (entry + 2 * TRANSPOSE_PREFETCH_DISTANCE < lastEntry)
+				{
+					__builtin_prefetch(&nextPosition[colIdx[entry + 2 * TRANSPOSE_PREFETCH_DISTANCE]], 1);
+				}
+				if (entry + TRANSPOSE_PREFETCH_DISTANCE < lastEntry)
+				{
+					long ahead = nextPosition[colIdx[entry + TRANSPOSE_PREFETCH_DISTANCE]];
+					__builtin_prefetch(resultMat.colIdx + ahead, 1);
+					__builtin_prefetch(resultMat.values + ahead, 1);
+				}
+				long target = nextPosition[colIdx[entry]]++;
+				resultMat.colIdx[target] = currRow;
+				resultMat.values[target] = values[entry];
+			}
+		}
+		vector<long>().swap(nextPosition); });
+	return resultMat;
+}
+
+WorkScheduler &SparseMatrix::getRowScheduler()
+{
+	// THE SPLIT IS COMPUTED AGAIN ONLY IF THE NUMBER OF THREADS CHANGED SINCE IT WAS COMPUTED
+	int numWorkers = chooseNumWorkers(rowPtr[rows], rows);
+	if (rowScheduler && rowScheduler->getNumWorkers() == numWorkers)
+	{
+		rowScheduler->reset();
+		return *rowScheduler;
+	}
+	delete rowScheduler;
+	rowScheduler = NULL;
 
-			// ITERATING OVER THE NON-ZERO ELEMENTS OF THE SECOND MATRIX
-			Node *currentNode2 = inputObject.treesArr[j].root;
+	// THE WORK OF A ROW IS ITS NUMBER OF ELEMENTS, PLUS ONE FOR VISITING IT
+	vector<long> workPrefix(rows + 1);
+	for (int currRow = 0; currRow <= rows; currRow++)
+	{
+		workPrefix[currRow] = rowPtr[currRow] + currRow;
+	}
+	rowScheduler = new WorkScheduler(workPrefix.data(), rows, numWorkers);
+	return *rowScheduler;
+}
 
-			// ITERATING OVER THE NON-ZERO ELEMENTS OF THE SECOND MATRIX ROW BY ROW
-			while (currentNode2 != NULL)
+// WHAT THE THREADS OF A MATRIX-VECTOR PRODUCT READ. THEIR LAMBDAS CAPTURE ONE POINTER TO IT, WHICH std::function
+// STORES WITHOUT ALLOCATING, SO THAT A PRODUCT ON ONE THREAD ALLOCATES NOTHING ONCE y AND THE SPLIT OF THE ROWS EXIST
+template <typename T>
+struct VectorProduct
+{
+	WorkScheduler *scheduler;
+	CSRArrays matrix;
+	int cols;
+	const T *x;
+	T *y;
+	T *partials; // VECTORS OF THE THREADS OTHER THAN THREAD 0 IN multiplyTransposed, cols ELEMENTS EACH
+	DotKernel<T> dot;
+	int numVectors; // NUMBER OF COLUMNS OF THE DENSE BLOCKS IN multiplyBlock
+	BlockKernel<T> block;
+};
+
+// MULTIPLYING THE MATRIX BY A DENSE VECTOR, ONE DOT PRODUCT PER ROW
+template <typename T>
+void SparseMatrix::multiply(const vector<T> &x, vector<T> &y)
+{
+	if ((long)x.size() != cols)
+	{
+		errorMessage("Size of the vector must be equal to the number of cols");
+	}
+	freeze();
+	y.resize(rows);
+
+	VectorProduct<T> product = {&getRowScheduler(), {rowPtr, colIdx, values}, cols, x.data(), y.data(), NULL, chooseDotKernel(x.data()), 0, NULL};
+	VectorProduct<T> *shared = &product;
+	product.scheduler->run([shared](int worker)
+						   {
+		const CSRArrays &matrix = shared->matrix;
+		int chunk;
+		while (shared->scheduler->nextChunk(worker, chunk))
+		{
+			for (int currRow = shared->scheduler->chunkStart(chunk); currRow < shared->scheduler->chunkStart(chunk + 1); currRow++)
 			{
-				// COL OF THE CURRENT NODE OF THE SECOND MATRIX
-				int k = currentNode2->col;
+				long first = matrix.rowPtr[currRow];
+				shared->y[currRow] = shared->dot(matrix.colIdx + first, matrix.values + first, matrix.rowPtr[currRow + 1] - first, shared->x);
+			}
+		} });
+}
 
-				// MULTIPLYING THE CORRESPONDING ELEMENTS FROM THE TWO ROWS
-				nbr = resultMat.getElement(i, k) + (currentNode->value * currentNode2->value);
+// MULTIPLYING THE TRANSPOSE OF THE MATRIX BY A DENSE VECTOR, ADDING EVERY ROW SCALED BY ITS ELEMENT OF x
+template <typename T>
+void SparseMatrix::multiplyTransposed(const vector<T> &x, vector<T> &y)
+{
+	if ((long)x.size() != rows)
+	{
+		errorMessage("Size of the vector must be equal to the number of rows");
+	}
+	freeze();
+	y.assign(cols, 0);
+
+	// THREAD 0 ADDS INTO y, AND EVERY OTHER THREAD INTO ITS OWN PART OF THE SCRATCH BUFFER, WHICH ONLY GROWS
+	WorkScheduler &scheduler = getRowScheduler();
+	int numWorkers = scheduler.getNumWorkers();
+	size_t scratchSize = (size_t)(numWorkers - 1) * cols * sizeof(T);
+	if (transposeScratch.size() < scratchSize)
+	{
+		transposeScratch.resize(scratchSize);
+	}
+	VectorProduct<T> product = {&scheduler, {rowPtr, colIdx, values}, cols, x.data(), y.data(), (T *)transposeScratch.data(), NULL, 0, NULL};
+	VectorProduct<T> *shared = &product;
+	scheduler.run([shared](int worker)
+				  {
+		const CSRArrays &matrix = shared->matrix;
+		T *output = (worker == 0) ? shared->y : shared->partials + (size_t)(worker - 1) * shared->cols;
+		if (worker > 0)
+		{
+			fill(output, output + shared->cols, (T)0);
+		}
+		int chunk;
+		while (shared->scheduler->nextChunk(worker, chunk))
+		{
+			for (int currRow = shared->scheduler->chunkStart(chunk); currRow < shared->scheduler->chunkStart(chunk + 1); currRow++)
+			{
+				T scale = shared->x[currRow];
+				if (scale == 0)
+				{
+					continue;
+				}
+				for (long entry = matrix.rowPtr[currRow]; entry < matrix.rowPtr[currRow + 1]; entry++)
+				{
+					output[matrix.colIdx[entry]] += (T)matrix.values[entry] * scale;
+				}
+			}
+		} });
 
-				// IF THE RESULT IS NOT ZERO, STORE IT IN THE RESULT MATRIX
-				if (nbr != 0)
+	// ADDING THE VECTORS OF THE OTHER THREADS INTO y, EVERY THREAD TAKING ONE RANGE OF COLUMNS
+	if (numWorkers > 1)
+	{
+		runInParallel(numWorkers, [shared](int worker)
+					  {
+			int numWorkers = shared->scheduler->getNumWorkers();
+			int firstCol = (int)((long)shared->cols * worker / numWorkers);
+			int lastCol = (int)((long)shared->cols * (worker + 1) / numWorkers);
+			for (int other = 0; other < numWorkers - 1; other++)
+			{
+				const T *partial = shared->partials + (size_t)other * shared->cols;
+				for (int currCol = firstCol; currCol < lastCol; currCol++)
 				{
-					// SET THE ELEMENT IN THE RESULT MATRIX
-					resultMat.setElement(i, k, nbr);
+					shared->y[currCol] += partial[currCol];
 				}
+			} });
+	}
+}
 
-				// MOVING TO THE NEXT NODE OF THE SECOND MATRIX ROW
-				currentNode2 = currentNode2->right;
+// MULTIPLYING THE MATRIX BY A BLOCK OF DENSE VECTORS, READING EVERY SPARSE ROW ONCE FOR ALL OF THEM
+template <typename T>
+void SparseMatrix::multiplyBlock(const vector<T> &X, int numVectors, vector<T> &Y)
+{
+	if (numVectors <= 0)
+	{
+		errorMessage("Number of vectors must be positive");
+	}
+	if (X.size() != (size_t)cols * numVectors)
+	{
+		errorMessage("Size of the block must be the number of cols times the number of vectors");
+	}
+	freeze();
+	Y.resize((size_t)rows * numVectors);
+
+	VectorProduct<T> product = {&getRowScheduler(), {rowPtr, colIdx, values}, cols, X.data(), Y.data(), NULL, NULL, numVectors, chooseBlockKernel(X.data())};
+	VectorProduct<T> *shared = &product;
+	product.scheduler->run([shared](int worker)
+						   {
+		const CSRArrays &matrix = shared->matrix;
+		int chunk;
+		while (shared->scheduler->nextChunk(worker, chunk))
+		{
+			for (int currRow = shared->scheduler->chunkStart(chunk); currRow < shared->scheduler->chunkStart(chunk + 1); currRow++)
+			{
+				long first = matrix.rowPtr[currRow];
+				shared->block(matrix.colIdx + first, matrix.values + first, matrix.rowPtr[currRow + 1] - first, shared->x,
+							  shared->numVectors, shared->y + (size_t)currRow * shared->numVectors);
 			}
+		} });
+}
 
-			// MOVING TO THE NEXT NODE OF THE FIRST MATRIX ROW
-			currentNode = currentNode->right;
+// THE TYPES OF VECTORS THE MATRIX CAN BE MULTIPLIED BY
+template void SparseMatrix::multiply<int>(const vector<int> &x, vector<int> &y);
+template void SparseMatrix::multiply<long>(const vector<long> &x, vector<long> &y);
+template void SparseMatrix::multiply<float>(const vector<float> &x, vector<float> &y);
+template void SparseMatrix::multiply<double>(const vector<double> &x, vector<double> &y);
+template void SparseMatrix::multiplyTransposed<int>(const vector<int> &x, vector<int> &y);
+template void SparseMatrix::multiplyTransposed<long>(const vector<long> &x, vector<long> &y);
+template void SparseMatrix::multiplyTransposed<float>(const vector<float> &x, vector<float> &y);
+template void SparseMatrix::multiplyTransposed<double>(const vector<double> &x, vector<double> &y);
+template void SparseMatrix::multiplyBlock<int>(const vector<int> &X, int numVectors, vector<int> &Y);
+template void SparseMatrix::multiplyBlock<long>(const vector<long> &X, int numVectors, vector<long> &Y);
+template void SparseMatrix::multiplyBlock<float>(const vector<float> &X, int numVectors, vector<float> &Y);
+template void SparseMatrix::multiplyBlock<double>(const vector<double> &X, int numVectors, vector<double> &Y);
+
+// NUMBER OF BUCKETS OF COLUMNS IN WHICH THE ELEMENTS OF THE SECOND MATRIX ARE COUNTED TO CUT IT IN COLUMN PANELS
+const int NUM_COLUMN_BUCKETS = 4096;
+
+// LARGEST AND SMALLEST stdio BUFFER OF A TEMPORARY FILE. AT MOST TWO OF THEM ARE OPEN AT ONCE, AND A SMALL BUDGET GETS SMALLER BUFFERS
+const long long MAX_SPILL_BUFFER_SIZE = 1 << 16;
+const long long MIN_SPILL_BUFFER_SIZE = 1 << 12;
+
+// TEMPORARY FILE HOLDING THE ROWS OF THE FIRST COLUMN PANELS OF A PRODUCT, IN ROW ORDER. IT IS CREATED NEXT TO THE OUTPUT FILE
+// AND REMOVED FROM ITS DIRECTORY AT ONCE, SO THAT IT DISAPPEARS WHEN IT IS CLOSED, EVEN IF THE PROGRAM STOPS ON AN ERROR
+class SpillFile
+{
+private:
+	FILE *stream;
+
+public:
+	SpillFile(const char *outputFileName, size_t bufferSize)
+	{
+		string path = string(outputFileName) + ".spill.XXXXXX";
+		vector<char> pathChars(path.begin(), path.end());
+		pathChars.push_back('\0');
+		int fileDescriptor = mkstemp(pathChars.data());
+		if (fileDescriptor < 0)
+		{
+			throw ios_base::failure("Cannot create a temporary file next to the output file");
+		}
+		unlink(pathChars.data());
+		stream = fdopen(fileDescriptor, "w+");
+		if (!stream)
+		{
+			close(fileDescriptor);
+			throw ios_base::failure("Cannot create a temporary file next to the output file");
 		}
+		setvbuf(stream, NULL, _IOFBF, bufferSize);
 	}
 
-	// RETURN THE RESULT MATRIX
-	return resultMat;
+	~SpillFile()
+	{
+		fclose(stream);
+	}
+
+	SpillFile(const SpillFile &other) = delete;
+	SpillFile &operator=(const SpillFile &other) = delete;
+
+	// A ROW IS STORED AS ITS NUMBER OF ELEMENTS FOLLOWED BY ITS COLUMNS AND ITS VALUES
+	void writeRow(const int *rowCols, const int *rowValues, long size)
+	{
+		if (fwrite(&size, sizeof(size), 1, stream) != 1 ||
+			(size > 0 && (fwrite(rowCols, sizeof(int), size, stream) != (size_t)size ||
+						  fwrite(rowValues, sizeof(int), size, stream) != (size_t)size)))
+		{
+			throw ios_base::failure("Cannot write to a temporary file");
+		}
+	}
+
+	void rewind()
+	{
+		if (fflush(stream) != 0 || fseek(stream, 0, SEEK_SET) != 0)
+		{
+			throw ios_base::failure("Cannot write to a temporary file");
+		}
+	}
+
+	// APPENDING THE NEXT ROW TO rowCols AND rowValues
+	void readRow(vector<int> &rowCols, vector<int> &rowValues)
+	{
+		long size;
+		size_t first = rowCols.size();
+		bool readFailed = fread(&size, sizeof(size), 1, stream) != 1 || size < 0;
+		if (!readFailed && size > 0)
+		{
+			rowCols.resize(first + size);
+			rowValues.resize(first + size);
+			readFailed = fread(rowCols.data() + first, sizeof(int), size, stream) != (size_t)size ||
+						 fread(rowValues.data() + first, sizeof(int), size, stream) != (size_t)size;
+		}
+		if (readFailed)
+		{
+			throw ios_base::failure("Cannot read a temporary file");
+		}
+	}
+};
+
+// FUNCTION TO COMPUTE THE ROWS OF first * second ON getNumThreads() THREADS, WHERE second IS A COLUMN PANEL width COLUMNS WIDE.
+// ROW i IS WRITTEN AT POSITION outStarts[i] OF outCols AND outValues, WHICH HAS ROOM FOR AS MANY ELEMENTS AS THE ROW CAN HAVE,
+// AND ITS NUMBER OF ELEMENTS IS SET IN rowSizes[i]
+void multiplyPanel(const CSRArrays &first, const CSRArrays &second, int numRows, int width, const long *workPrefix,
+				   const long *outStarts, int *outCols, int *outValues, long *rowSizes)
+{
+	WorkScheduler scheduler(workPrefix, numRows, chooseNumWorkers(workPrefix[numRows], numRows));
+	scheduler.run([&](int worker)
+				  {
+		// THE TWO PHASES MARK THE COLUMNS OF A ROW WITH THE NUMBER OF THE ROW, SO EACH ONE HAS ITS OWN WORKSPACE
+		ProductRowWorkspace symbolicWorkspace(width);
+		ProductRowWorkspace numericWorkspace(width);
+		vector<int> structCols;
+		int chunk;
+		while (scheduler.nextChunk(worker, chunk))
+		{
+			for (int i = scheduler.chunkStart(chunk); i < scheduler.chunkStart(chunk + 1); i++)
+			{
+				structCols.clear();
+				symbolicWorkspace.symbolicRow(first, second, i, structCols);
+				rowSizes[i] = numericWorkspace.numericRow(first, second, i, structCols.data(), structCols.size(),
+														  outCols + outStarts[i], outValues + outStarts[i]);
+			}
+		} });
+}
+
+// MULTIPLYING TWO MATRIX FILES IN BLOCKS THAT FIT IN THE MEMORY BUDGET
+void SparseMatrix::multiplyFiles(char *inputFileName1, char *inputFileName2, char *outputFileName, long long memoryBudget, bool matrixMarketOutput)
+{
+	if (memoryBudget <= 0)
+	{
+		errorMessage("Memory budget must be positive");
+	}
+
+	// THE DIMENSIONS ARE CHECKED AS FOR operator*, AND THE ELEMENTS OF THE SECOND MATRIX ARE COUNTED IN BUCKETS OF COLUMNS
+	int numRows, innerSize, numCols, bucketWidth;
+	vector<long> bucketCounts;
+	{
+		MatrixRowReader reader1(inputFileName1);
+		MatrixRowReader reader2(inputFileName2);
+		if (reader2.getRows() != reader1.getCols())
+		{
+			errorMessage("Input does not satisfy following condition: Number of rows in second matrix must be equal to num of cols in first matrix");
+		}
+		if (reader2.getCols() != reader1.getRows())
+		{
+			errorMessage("Input does not satisfy following condition: Number of cols in second matrix must be equal to num of rows in first matrix");
+		}
+		numRows = reader1.getRows();
+		innerSize = reader1.getCols();
+		numCols = reader2.getCols();
+
+		bucketWidth = (int)(((long)numCols + NUM_COLUMN_BUCKETS - 1) / NUM_COLUMN_BUCKETS);
+		bucketCounts.assign(((long)numCols + bucketWidth - 1) / bucketWidth, 0);
+		vector<int> rowCols, rowValues;
+		for (int j = 0; j < innerSize; j++)
+		{
+			reader2.readRow(rowCols, rowValues);
+			for (size_t e = 0; e < rowCols.size(); e++)
+			{
+				bucketCounts[rowCols[e] / bucketWidth]++;
+			}
+		}
+	}
+
+	// HALF OF THE BUDGET HOLDS A COLUMN PANEL OF THE SECOND MATRIX AND THE OTHER HALF A ROW PANEL OF THE FIRST ONE WITH ITS
+	// PRODUCT. THE COLUMN PANELS ARE CUT BETWEEN BUCKETS, AND A BUCKET LARGER THAN THE BUDGET MAKES A PANEL OF ITS OWN.
+	// WHEN THERE IS MORE THAN ONE PANEL, THE BUFFERS OF THE TWO TEMPORARY FILES ARE TAKEN FROM THE BUDGET FIRST
+	long long rowPtrBytes = ((long long)innerSize + 1) * sizeof(long);
+	long long spillBufferSize = max(min(MAX_SPILL_BUFFER_SIZE, memoryBudget / 16), MIN_SPILL_BUFFER_SIZE);
+	long long panelBudget = memoryBudget / 2;
+	vector<int> panelStarts;
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		panelStarts.assign(1, 0);
+		long long panelBytes = rowPtrBytes;
+		for (size_t bucket = 0; bucket < bucketCounts.size(); bucket++)
+		{
+			long long bucketBytes = bucketCounts[bucket] * (long long)(2 * sizeof(int));
+			int bucketStart = (int)(bucket * bucketWidth);
+			if (bucketStart > panelStarts.back() && panelBytes + bucketBytes > panelBudget)
+			{
+				panelStarts.push_back(bucketStart);
+				panelBytes = rowPtrBytes;
+			}
+			panelBytes += bucketBytes;
+		}
+		panelStarts.push_back(numCols);
+		if (panelStarts.size() == 2)
+		{
+			break;
+		}
+		panelBudget = (memoryBudget - 2 * spillBufferSize) / 2;
+	}
+	int numPanels = (int)panelStarts.size() - 1;
+	LogManager::writePrintfToLog(LogManager::Level::Status, "SparseMatrix::multiplyFiles",
+								 "Multiplying %s and %s in %d column panels to file: %s", inputFileName1, inputFileName2, numPanels, outputFileName);
+
+	// THE ROWS OF THE PANELS BEFORE THE CURRENT ONE ARE KEPT IN A TEMPORARY FILE. EVERY ROW OF THE CURRENT PANEL IS APPENDED
+	// TO THE SAME ROW OF THAT FILE AND WRITTEN TO A NEW ONE, OR TO THE OUTPUT FILE FOR THE LAST PANEL, SO ONLY TWO ARE OPEN
+	RowStreamWriter writer(outputFileName, numRows, numCols, matrixMarketOutput);
+	SpillFile *mergedFile = NULL;
+	SpillFile *nextFile = NULL;
+	try
+	{
+		vector<int> rowCols, rowValues;
+		vector<int> mergedCols, mergedValues;
+		vector<pair<int, int> > rowEntries;
+		for (int panel = 0; panel < numPanels; panel++)
+		{
+			int firstCol = panelStarts[panel];
+			int width = panelStarts[panel + 1] - firstCol;
+			if (mergedFile)
+			{
+				mergedFile->rewind();
+			}
+			if (panel < numPanels - 1)
+			{
+				nextFile = new SpillFile(outputFileName, spillBufferSize);
+			}
+
+			// LOADING THE COLUMNS OF THE PANEL FROM EVERY ROW OF THE SECOND MATRIX, NUMBERED FROM THE FIRST COLUMN OF THE PANEL
+			vector<long> secondRowPtr(innerSize + 1, 0);
+			vector<int> secondColIdx, secondValues;
+			{
+				MatrixRowReader reader2(inputFileName2);
+				for (int j = 0; j < innerSize; j++)
+				{
+					reader2.readRow(rowCols, rowValues);
+					long size = cleanRow(rowCols.data(), rowValues.data(), rowCols.size(), rowEntries);
+					for (long e = 0; e < size; e++)
+					{
+						if (rowCols[e] >= firstCol && rowCols[e] - firstCol < width)
+						{
+							secondColIdx.push_back(rowCols[e] - firstCol);
+							secondValues.push_back(rowValues[e]);
+						}
+					}
+					secondRowPtr[j + 1] = secondColIdx.size();
+				}
+			}
+			CSRArrays second = {secondRowPtr.data(), secondColIdx.data(), secondValues.data()};
+
+			// READING THE FIRST MATRIX IN PANELS OF ROWS THAT, WITH THE ELEMENTS THEIR PRODUCT CAN HAVE, FIT IN THE OTHER HALF OF THE BUDGET
+			MatrixRowReader reader1(inputFileName1);
+			vector<long> firstRowPtr(1, 0);
+			vector<int> firstColIdx, firstValues;
+			vector<long> workPrefix(1, 0);
+			vector<long> outStarts(1, 0);
+			int panelFirstRow = 0;
+			for (int currRow = 0; currRow < numRows; currRow++)
+			{
+				reader1.readRow(rowCols, rowValues);
+				long size = cleanRow(rowCols.data(), rowValues.data(), rowCols.size(), rowEntries);
+				long products = 0;
+				for (long e = 0; e < size; e++)
+				{
+					firstColIdx.push_back(rowCols[e]);
+					firstValues.push_back(rowValues[e]);
+					products += secondRowPtr[rowCols[e] + 1] - secondRowPtr[rowCols[e]];
+				}
+				firstRowPtr.push_back(firstColIdx.size());
+				workPrefix.push_back(workPrefix.back() + products + 1);
+				outStarts.push_back(outStarts.back() + min(products, (long)width));
+
+				long long rowPanelBytes = (long long)firstColIdx.size() * (2 * sizeof(int)) +
+										  (long long)firstRowPtr.size() * (3 * sizeof(long)) + outStarts.back() * (2 * sizeof(int));
+				if (rowPanelBytes < panelBudget && currRow < numRows - 1)
+				{
+					continue;
+				}
+
+				// COMPUTING THE BLOCK OF THE PRODUCT FOR THE ROWS OF THE PANEL, AND WRITING ITS ROWS IN ORDER
+				int panelRows = currRow + 1 - panelFirstRow;
+				CSRArrays first = {firstRowPtr.data(), firstColIdx.data(), firstValues.data()};
+				vector<int> outCols(outStarts.back()), outValues(outStarts.back());
+				vector<long> rowSizes(panelRows);
+				multiplyPanel(first, second, panelRows, width, workPrefix.data(), outStarts.data(), outCols.data(), outValues.data(), rowSizes.data());
+				for (int i = 0; i < panelRows; i++)
+				{
+					int *blockCols = outCols.data() + outStarts[i];
+					for (long e = 0; e < rowSizes[i]; e++)
+					{
+						blockCols[e] += firstCol;
+					}
+					mergedCols.clear();
+					mergedValues.clear();
+					if (mergedFile)
+					{
+						mergedFile->readRow(mergedCols, mergedValues);
+					}
+					mergedCols.insert(mergedCols.end(), blockCols, blockCols + rowSizes[i]);
+					mergedValues.insert(mergedValues.end(), outValues.data() + outStarts[i], outValues.data() + outStarts[i] + rowSizes[i]);
+					if (nextFile)
+					{
+						nextFile->writeRow(mergedCols.data(), mergedValues.data(), mergedCols.size());
+					}
+					else
+					{
+						writer.writeRow(panelFirstRow + i, mergedCols.data(), mergedValues.data(), mergedCols.size());
+					}
+				}
+
+				firstRowPtr.assign(1, 0);
+				firstColIdx.clear();
+				firstValues.clear();
+				workPrefix.assign(1, 0);
+				outStarts.assign(1, 0);
+				panelFirstRow = currRow + 1;
+			}
+			delete mergedFile;
+			mergedFile = nextFile;
+			nextFile = NULL;
+		}
+	}
+	catch (...)
+	{
+		delete mergedFile;
+		delete nextFile;
+		throw;
+	}
+	writer.close();
 }
 
 void SparseMatrixTester::generateTestCases(char *outputFolderPath)
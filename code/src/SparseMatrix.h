@@ -11,6 +11,7 @@
 #include <limits.h>
 #include <math.h>
 #include <unistd.h>
+#include <vector>
 #include "../../util/GetMemUsage.h"
 #include "../../util/LogManager.h"
 
@@ -20,11 +21,14 @@ struct Node
 	int value;
 	int row;
 	int col;
+	int height; // HEIGHT OF THE SUBTREE ROOTED AT THE NODE, USED TO KEEP THE TREE BALANCED (AVL)
 	Node *left; // LEFT CHILD OF THE NODE
 	Node *right; // RIGHT CHILD OF THE NODE
 };
 
-// CREATING A BST FOR STORING NON-ZERO ELEMENTS WITH THE SAME ROW
+// CREATING A BST FOR STORING NON-ZERO ELEMENTS WITH THE SAME ROW.
+// THE TREE IS KEPT BALANCED AS AN AVL TREE SO THAT LOOKUPS AND INSERTS ARE O(log k) FOR A ROW WITH k ELEMENTS,
+// EVEN WHEN THE ELEMENTS ARRIVE IN INCREASING COLUMN ORDER
 struct BSTree
 {
 	// CREATING A ROOT NODE FOR THE BST
@@ -37,6 +41,72 @@ struct BSTree
 	}
 };
 
+// ALLOCATOR THAT CARVES THE NODES OF ONE MATRIX FROM LARGE CONTIGUOUS SLABS INSTEAD OF ONE new PER NODE.
+// NODES OF REMOVED ELEMENTS GO TO A FREE LIST AND ARE REUSED, AND ALL THE SLABS ARE RELEASED AT ONCE
+class NodeArena
+{
+private:
+	static const long MIN_SLAB_NODES = 64;	  // SIZE OF THE FIRST SLAB, SO SMALL MATRICES STAY SMALL
+	static const long MAX_SLAB_NODES = 65536; // SLABS DOUBLE IN SIZE UP TO 2 MB
+
+	std::vector<Node *> slabs;
+	long slabSize;	 // NUMBER OF NODES IN THE LAST SLAB
+	long slabUsed;	 // NUMBER OF NODES ALREADY HANDED OUT FROM THE LAST SLAB
+	Node *freeList; // RELEASED NODES, LINKED THROUGH THEIR right POINTER
+
+public:
+	NodeArena();
+	~NodeArena();
+
+	// AN ARENA OWNS ITS SLABS, SO IT CAN BE MOVED BUT NOT COPIED
+	NodeArena(const NodeArena &) = delete;
+	NodeArena &operator=(const NodeArena &) = delete;
+	NodeArena(NodeArena &&other);
+	NodeArena &operator=(NodeArena &&other);
+
+	/**
+	 * Return an uninitialized node, taken from the free list if possible, else from the current slab.
+	 */
+	Node *allocate();
+
+	/**
+	 * Give a node back to the arena so that a later allocate() can reuse it.
+	 */
+	void release(Node *node);
+
+	/**
+	 * Make sure that the next numNodes allocations do not need more than one new slab.
+	 */
+	void reserve(long numNodes);
+
+	/**
+	 * Release all the slabs at once. Every node handed out by the arena becomes invalid.
+	 */
+	void releaseAll();
+};
+
+// ONE NON-ZERO ELEMENT OF A MATRIX GIVEN AS A (ROW, COLUMN, VALUE) TRIPLE, USED TO BUILD A MATRIX IN BULK
+struct MatrixEntry
+{
+	int row;
+	int col;
+	int value;
+};
+
+// STRUCTURE OF THE PRODUCT OF TWO MATRICES: THE SORTED COLUMNS OF THE ELEMENTS OF EACH ROW, IN CSR FORM.
+// IT IS COMPUTED BY SparseMatrix::multiplySymbolic AND CAN BE REUSED BY SparseMatrix::multiplyNumeric
+// FOR MATRICES WITH THE SAME SPARSITY PATTERNS AS THE ONES IT WAS COMPUTED FROM
+struct ProductStructure
+{
+	int rows;
+	int cols;
+	std::vector<long> rowPtr; // SIZE rows + 1
+	std::vector<int> colIdx;  // SIZE rowPtr[rows]
+};
+
+class MappedFile;
+class WorkScheduler;
+
 // CREATING A CLASS FOR SPARSE MATRIX
 class SparseMatrix
 {
@@ -44,16 +114,124 @@ private:
 	int rows;
 	int cols;
 
-	// ARRAY TO STORE BINARY SEARCH TREES WITH SIZE = NUMBER OF ROWS
+	// NUMBER OF THREADS USED BY THE MATRIX OPERATIONS, SHARED BY ALL THE MATRICES
+	static int numThreads;
+
+	// ARRAY TO STORE BINARY SEARCH TREES WITH SIZE = NUMBER OF ROWS (NULL WHILE THE MATRIX IS FROZEN)
 	BSTree *treesArr;
 
+	// ALLOCATOR OWNING ALL THE NODES OF THE ROW TREES
+	NodeArena arena;
+
+	// COMPRESSED SPARSE ROW (CSR) STORAGE USED WHILE THE MATRIX IS FROZEN.
+	// THE NON-ZERO ELEMENTS OF ROW r ARE AT POSITIONS rowPtr[r] .. rowPtr[r + 1] - 1 OF colIdx AND values, SORTED BY COLUMN
+	bool frozen;
+	long *rowPtr;
+	int *colIdx;
+	int *values;
+
+	// BINARY FILE THE CSR ARRAYS POINT INTO WHEN THE MATRIX WAS OPENED FROM ONE, OR NULL WHEN THE MATRIX OWNS ITS ARRAYS
+	MappedFile *mappedFile;
+
+	// SPLIT OF THE ROWS OF THE CSR ARRAYS BETWEEN THE THREADS, KEPT FOR THE NEXT MATRIX-VECTOR PRODUCT (NULL UNTIL THE FIRST ONE)
+	// AND RELEASED WITH THE ARRAYS, AND THE PARTIAL RESULTS OF THE THREADS OF multiplyTransposed
+	WorkScheduler *rowScheduler;
+	std::vector<char> transposeScratch;
+
+	/**
+	 * Release the CSR arrays, or the mapped file they point into, and set them to NULL.
+	 */
+	void releaseCSR();
+
+	/**
+	 * Return the split of the rows of the frozen matrix between getNumThreads() threads, by their numbers of elements.
+	 * The split is computed on the first call and handed out again on the next ones, until the CSR arrays change.
+	 */
+	WorkScheduler &getRowScheduler();
+
+	/**
+	 * Serve the CSR arrays straight from a mapped binary matrix file (see MatrixBinaryFormat.h),
+	 * after checking its header and checksum. The matrix takes over the mapping.
+	 */
+	void openBinary(MappedFile &file, const char *filePath);
+
+	/**
+	 * Write the matrix in the binary format, with extraSize extra header bytes (a multiple of 8) after the header.
+	 */
+	void writeBinary(const char *outputFileName, const void *extraHeader, size_t extraSize);
+
+	/**
+	 * Print a frozen matrix to an output file on getNumThreads() threads: the length of every row is counted first,
+	 * which gives the position of every row in the file, and chunks of rows are then formatted and written at their
+	 * positions with pwrite.
+	 */
+	void printInParallel(char *outputFileName);
+
+	/**
+	 * Rebuild the row trees from the CSR arrays and release the arrays,
+	 * so that the matrix can be modified again.
+	 */
+	void thaw();
+
+	/**
+	 * Build the CSR arrays of the matrix from lists of (row, col, value) triples and mark the matrix as frozen.
+	 * The lists are read as if they were one list, in order: entryLists[0] first, then entryLists[1], and so on.
+	 * Consecutive lists are counted and placed in their rows by different threads. rows and cols must already be set.
+	 */
+	void buildFromEntries(const MatrixEntry *const *entryLists, const long *listSizes, int numLists);
+
+	/**
+	 * Release the row trees and freeze the matrix with room for capacity elements in its CSR arrays,
+	 * so that a kernel can write the rows of a result straight into them.
+	 * The kernel either writes the rows one after the other, setting rowPtr[r + 1] after row r (rowPtr[0] is already 0),
+	 * or writes each row at a start position of its own and then calls packRows.
+	 */
+	void beginRows(long capacity);
+
+	/**
+	 * Finish CSR arrays started by beginRows in which row r was written at position rowStarts[r] with rowSizes[r] elements,
+	 * possibly with gaps between the rows: copy the rows one after the other into arrays of exactly the right size
+	 * and set rowPtr. Chunks of rows holding about the same number of elements are copied on getNumThreads() threads.
+	 */
+	void packRows(const long *rowStarts, const long *rowSizes);
+
+	/**
+	 * Add (sign = 1) or subtract (sign = -1) inputObject by merging the sorted rows of both matrices.
+	 * Chunks of rows holding about the same number of elements are merged on getNumThreads() threads.
+	 * The dimensions must already be checked.
+	 */
+	SparseMatrix mergeMatrices(SparseMatrix &inputObject, int sign);
+
+	/**
+	 * Add (sign = 1) or subtract (sign = -1) the matrices of two files row by row with MatrixRowReader,
+	 * writing every row of the result as soon as it is merged.
+	 */
+	static void mergeFiles(char *inputFileName1, char *inputFileName2, char *outputFileName, int sign, bool matrixMarketOutput);
+
+	/**
+	 * Throw an error of type invalid_argument if this matrix cannot be multiplied by inputObject.
+	 */
+	void checkProductDimensions(SparseMatrix &inputObject);
+
 public:
 	/**
 	 * Given an input text file, load the matrix values into the matrix dta structure.
+	 * The elements are read first and then built into CSR arrays in one pass, so the loaded matrix is frozen.
 	 *
 	 * @param matrixFilePath Path of the file which contains the data to create a matrix.
 	 *
-	 * If the input file cannot be read throw an error of type ios_base::failure
+	 * A binary matrix file written by writeBinaryFile is recognized by its first bytes and is not read at all:
+	 * the file is mapped and the CSR arrays are served from the mapped pages, after its checksum is verified.
+	 * When MatrixFileCache is enabled, a text file is opened from its cached binary form if it has not changed,
+	 * and its cached binary form is written after it is parsed otherwise.
+	 *
+	 * If the input file cannot be read throw an error of type ios_base::failure.
+	 * The text file can also be a Matrix Market coordinate file (see MatrixScanner). A symmetric or skew-symmetric
+	 * one lists one triangle and is expanded to the whole matrix as it is read.
+	 *
+	 * If a line of the file is malformed throw an error of type invalid_argument giving the line number (see MatrixScanner).
+	 * If a Matrix Market file does not have the number of elements given in its size line throw an error of type invalid_argument.
+	 * If a binary file is truncated, has column numbers out of range or out of order, or fails its checksum throw an error of type invalid_argument.
 	 */
 	SparseMatrix(char *matrixFilePath);
 
@@ -62,11 +240,67 @@ public:
 	 * Since this is a sparse matrix, all values will be zeros unless filled.
 	 */
 	SparseMatrix(int numRows, int numCols);
+
+	/**
+	 * Create a sparse matrix with numRows and numCols from an array of (row, col, value) triples
+	 * without inserting the elements one by one.
+	 * The triples are grouped by row with a counting sort and a row is sorted by column only if its triples
+	 * did not arrive in increasing column order, so already sorted input is built in O(numEntries + numRows).
+	 * As with setElement, the last value given for a position is kept and a value of 0 leaves the position empty.
+	 * The new matrix is frozen.
+	 *
+	 * If a triple is outside the matrix, throw an error of type invalid_argument
+	 */
+	SparseMatrix(int numRows, int numCols, MatrixEntry *entries, long numEntries);
+
+	/**
+	 * Create a deep copy of another matrix, in the same storage mode (row trees or frozen CSR arrays).
+	 * The copy constructor is explicit so that a matrix is only copied when asked for, as in SparseMatrix copy(matrix);
+	 */
+	explicit SparseMatrix(const SparseMatrix &other);
+
+	/**
+	 * Take over the storage of another matrix without copying it. The other matrix is left empty (0 x 0).
+	 * Operator results and loaded matrices are handed over this way.
+	 */
+	SparseMatrix(SparseMatrix &&other);
+	SparseMatrix &operator=(SparseMatrix &&other);
+
+	// A MATRIX IS NEVER COPIED IMPLICITLY BY ASSIGNMENT, USE THE EXPLICIT COPY CONSTRUCTOR INSTEAD
+	SparseMatrix &operator=(const SparseMatrix &other) = delete;
+
+	/**
+	 * Release the row trees with all their nodes and the CSR arrays.
+	 */
+	~SparseMatrix();
 	/**
 	 * Print the matrix to an output file.
+	 * Only the stored elements are visited, row by row in column order, so the cost is O(nnz + rows).
+	 * The lines are formatted with to_chars in a large buffer that is written with one fwrite per megabyte,
+	 * and a large frozen matrix is formatted on several threads, with exactly the same output.
+	 *
+	 * If the output file cannot be opened or written throw an error of type ios_base::failure
 	 */
 	void printToASCIIFile(char *outputFileName);
 
+	/**
+	 * Write the matrix to an output file in the Matrix Market coordinate format
+	 * ("%%MatrixMarket matrix coordinate integer general"), with rows and columns starting at 1.
+	 * The matrix is frozen first and its rows are written in order from the CSR arrays.
+	 *
+	 * If the output file cannot be opened or written throw an error of type ios_base::failure
+	 */
+	void writeMatrixMarketFile(char *outputFileName);
+
+	/**
+	 * Write the matrix to an output file in the binary format of MatrixBinaryFormat.h, which the file
+	 * constructor opens without parsing. The matrix is frozen first, and the header and the three CSR arrays
+	 * are then written with one sequential write each.
+	 *
+	 * If the output file cannot be opened or written throw an error of type ios_base::failure
+	 */
+	void writeBinaryFile(char *outputFileName);
+
 	/**
 	 * Return the value of the element located at a position in the matrix
 	 * @param currRow Row of the position whose value is needed.
@@ -80,11 +314,43 @@ public:
 	 * @param currCol Col of the position whose value is needed.
 	 * @param value Value of the element
 	 *
+	 * Setting a value of 0 removes the element from the matrix.
+	 *
 	 * @return int: 1 In case the value is set. -1 if the value is not set (currRow > rows or currCol > cols) or currRow or currCol is -ve
 	 *
 	 */
 	int setElement(int currRow, int currCol, int value);
 
+	/**
+	 * Convert the matrix to its compressed sparse row (CSR) form and release the row trees.
+	 * A frozen matrix uses about 8 bytes per non-zero element and scans its rows sequentially in memory.
+	 * Calling setElement on a frozen matrix rebuilds the row trees first.
+	 * Freezing a matrix that is already frozen does nothing.
+	 */
+	void freeze();
+
+	/**
+	 * Return true if the matrix is stored in its compressed sparse row (CSR) form.
+	 */
+	bool isFrozen();
+
+	/**
+	 * Set the number of threads used by the matrix operations. With 1, everything runs on the calling thread.
+	 * The default is the number of cores reported by std::thread::hardware_concurrency().
+	 * Small inputs are always processed on the calling thread only.
+	 *
+	 * If numThreads is not positive throw an error of type invalid_argument
+	 */
+	static void setNumThreads(int numThreads);
+
+	/**
+	 * Return the number of threads used by the matrix operations.
+	 */
+	static int getNumThreads();
+
+	// THE OPERATORS RUN ON THE CSR FORM OF THE MATRICES: BOTH OPERANDS ARE FROZEN BEFORE COMPUTING AND SO IS THE RESULT.
+	// LARGE INPUTS ARE SPLIT IN BLOCKS OF ROWS PROCESSED ON getNumThreads() THREADS
+
 	// operator+ IS A CALL TO THE DEFAULT CONSTRUCTOR OF THE CLASS SparseMatrix
 	SparseMatrix operator+(SparseMatrix &inputObject);
 
@@ -92,7 +358,107 @@ public:
 	SparseMatrix operator-(SparseMatrix &inputObject);
 
 	// operator* IS A CALL TO THE DEFAULT CONSTRUCTOR OF THE CLASS SparseMatrix
+	// IT IS multiplyNumeric(inputObject, multiplySymbolic(inputObject))
 	SparseMatrix operator*(SparseMatrix &inputObject);
+
+	/**
+	 * Return the transpose of the matrix, frozen, with cols rows and rows cols. The matrix is frozen first and its
+	 * elements are placed with a parallel counting sort by column (count, prefix sum, scatter), in O(elements + cols)
+	 * without any tree insert or sort. Row c of the result lists column c of this matrix in increasing row order, so
+	 * its CSR arrays are the compressed sparse column (CSC) arrays of this matrix: for example, result.multiply(x, y)
+	 * computes A^T x with one dot product per column and no per-thread partial vectors.
+	 */
+	SparseMatrix transpose();
+
+	/**
+	 * Symbolic phase of the multiplication by inputObject: find the positions where the product can have
+	 * non-zero elements, without computing any value. Blocks of rows are processed on getNumThreads() threads.
+	 * The structure can be kept and passed to multiplyNumeric again whenever the matrices get new values
+	 * but keep the same sparsity patterns, which skips this phase.
+	 *
+	 * If the matrices cannot be multiplied throw an error of type invalid_argument
+	 */
+	ProductStructure multiplySymbolic(SparseMatrix &inputObject);
+
+	/**
+	 * Numeric phase of the multiplication by inputObject: compute the values of the product at the positions
+	 * given by structure and write them into CSR arrays allocated to exactly that size.
+	 * Blocks of rows are processed on getNumThreads() threads, each with its own accumulators.
+	 * Elements whose sum is zero are left out of the result.
+	 *
+	 * If the matrices cannot be multiplied, or if a product falls outside the structure (the sparsity patterns
+	 * changed since multiplySymbolic), throw an error of type invalid_argument
+	 */
+	SparseMatrix multiplyNumeric(SparseMatrix &inputObject, const ProductStructure &structure);
+
+	/**
+	 * Multiply the matrix by the dense vector x and write the result to y (y = A x), which is resized to the
+	 * number of rows. T can be int, long, float or double. The matrix is frozen first, and every row is a dot
+	 * product with x, computed with AVX2 gathers when the processor has them (see VectorKernels.h).
+	 * Blocks of rows holding about the same number of elements are computed on getNumThreads() threads.
+	 * Calling it again with the same y allocates nothing: the split of the rows is kept with the matrix, and the
+	 * threads are kept by runInParallel (see WorkScheduler.h).
+	 *
+	 * If x does not have one element per column throw an error of type invalid_argument
+	 */
+	template <typename T>
+	void multiply(const std::vector<T> &x, std::vector<T> &y);
+
+	/**
+	 * Multiply the transpose of the matrix by the dense vector x (y = A^T x), with y resized to the number of columns.
+	 * Every row r adds x[r] times its elements to y. With several threads, each thread adds its blocks of rows into
+	 * a vector of its own, kept with the matrix for the next calls, and the vectors are added together at the end.
+	 *
+	 * If x does not have one element per row throw an error of type invalid_argument
+	 */
+	template <typename T>
+	void multiplyTransposed(const std::vector<T> &x, std::vector<T> &y);
+
+	/**
+	 * Multiply the matrix by a block of numVectors dense vectors (Y = A X). X is stored row-major, numVectors
+	 * values per row and cols rows, and Y is resized to rows rows of numVectors values. Every sparse row is read
+	 * once and its elements scale whole rows of X, which are contiguous, so the numVectors outputs of a row are
+	 * added with vector instructions instead of one gather per element and vector as in numVectors calls to
+	 * multiply. The rows are split between threads like in multiply.
+	 *
+	 * If numVectors is not positive or X does not have cols * numVectors elements throw an error of type invalid_argument
+	 */
+	template <typename T>
+	void multiplyBlock(const std::vector<T> &X, int numVectors, std::vector<T> &Y);
+
+	/**
+	 * Add the matrices of two files and write the sum to an output file without loading the matrices:
+	 * the files are read one row at a time in lockstep, and every row of the sum is written as soon as it
+	 * is computed, so the memory used is bounded by the longest row instead of the number of elements.
+	 * The input files can be text, general Matrix Market or binary files, and their elements must be
+	 * ordered by row. The sum is written in the text format, or in the Matrix Market format if matrixMarketOutput is set.
+	 *
+	 * If the files have different dimensions, are malformed or are not ordered by row throw an error of type invalid_argument
+	 * If a file cannot be read or written throw an error of type ios_base::failure
+	 */
+	static void addFiles(char *inputFileName1, char *inputFileName2, char *outputFileName, bool matrixMarketOutput = false);
+
+	/**
+	 * Subtract the matrix of the second file from the matrix of the first one, row by row as addFiles does.
+	 */
+	static void subtractFiles(char *inputFileName1, char *inputFileName2, char *outputFileName, bool matrixMarketOutput = false);
+
+	/**
+	 * Multiply the matrices of two files and write the product to an output file, using about memoryBudget bytes.
+	 * The second matrix is cut into panels of columns that fit in half of the budget, and the first one is read
+	 * in panels of rows that, with the elements of their product, fit in the other half. Every block of the product
+	 * is computed on getNumThreads() threads like operator* does. With more than one column panel, the rows of the
+	 * panels already computed are kept in a temporary file next to the output file, and the rows of every new panel
+	 * are appended to them into a new temporary file, or into the output file for the last panel. At most two
+	 * temporary files are open at once, and their buffers are counted in the budget. Every file is read once per
+	 * column panel, one row at a time, so the input files can be larger than the memory, with the same requirements
+	 * as for addFiles.
+	 *
+	 * If the matrices cannot be multiplied, are malformed, or are not ordered by row, throw an error of type invalid_argument
+	 * If a file cannot be read or written throw an error of type ios_base::failure
+	 */
+	static void multiplyFiles(char *inputFileName1, char *inputFileName2, char *outputFileName, long long memoryBudget,
+							  bool matrixMarketOutput = false);
 };
 
 class SparseMatrixTester
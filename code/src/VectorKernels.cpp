@@ -0,0 +1,347 @@
+#include "VectorKernels.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNELS 1
+#endif
+
+// TYPE THE PLAIN LOOPS ADD IN: THE INTEGER SUMS ARE UNSIGNED, SO THAT THEY WRAP AROUND ON OVERFLOW
+// LIKE THE AVX2 KERNELS DO INSTEAD OF BEING UNDEFINED
+template <typename T>
+struct SumType
+{
+	typedef T type;
+};
+template <>
+struct SumType<int>
+{
+	typedef unsigned int type;
+};
+template <>
+struct SumType<long>
+{
+	typedef unsigned long type;
+};
+
+// PLAIN LOOP, FOR EVERY TYPE AND EVERY PROCESSOR
+template <typename T>
+T scalarDot(const int *rowCols, const int *rowValues, long size, const T *x)
+{
+	typedef typename SumType<T>::type U;
+	U sum = 0;
+	for (long entry = 0; entry < size; entry++)
+	{
+		sum += (U)rowValues[entry] * (U)x[rowCols[entry]];
+	}
+	return (T)sum;
+}
+
+// PLAIN LOOP OVER THE OUTPUTS firstVector .. numVectors - 1 OF A ROW OF A BLOCK PRODUCT
+template <typename T>
+void scalarBlockRow(const int *rowCols, const int *rowValues, long size, const T *X, int numVectors, int firstVector, T *yRow)
+{
+	for (int vector = firstVector; vector < numVectors; vector++)
+	{
+		yRow[vector] = 0;
+	}
+	typedef typename SumType<T>::type U;
+	for (long entry = 0; entry < size; entry++)
+	{
+		U value = (U)rowValues[entry];
+		const T *xRow = X + (size_t)rowCols[entry] * numVectors;
+		for (int vector = firstVector; vector < numVectors; vector++)
+		{
+			yRow[vector] = (T)((U)yRow[vector] + value * (U)xRow[vector]);
+		}
+	}
+}
+
+template <typename T>
+void scalarBlock(const int *rowCols, const int *rowValues, long size, const T *X, int numVectors, T *yRow)
+{
+	scalarBlockRow(rowCols, rowValues, size, X, numVectors, 0, yRow);
+}
+
+#ifdef HAVE_AVX2_KERNELS
+
+// THE AVX2 KERNELS ARE COMPILED FOR AVX2 WHATEVER THE FLAGS OF THE BUILD, AND ONLY CALLED WHEN THE PROCESSOR HAS IT.
+// THEIR GATHERS ARE THE MASKED FORM WITH EVERY LANE ENABLED, WHICH STARTS FROM ZERO INSTEAD OF AN UNDEFINED REGISTER
+bool cpuHasAVX2()
+{
+	static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	return supported;
+}
+
+// 8 ELEMENTS PER STEP: THE COLUMNS INDEX THE GATHER OF x AND THE VALUES ARE CONVERTED TO float
+__attribute__((target("avx2,fma"))) float avx2DotFloat(const int *rowCols, const int *rowValues, long size, const float *x)
+{
+	__m256 sum = _mm256_setzero_ps();
+	__m256 allLanes = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	long entry = 0;
+	for (; entry + 8 <= size; entry += 8)
+	{
+		__m256i cols = _mm256_loadu_si256((const __m256i *)(rowCols + entry));
+		__m256 values = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(rowValues + entry)));
+		sum = _mm256_fmadd_ps(values, _mm256_mask_i32gather_ps(_mm256_setzero_ps(), x, cols, allLanes, sizeof(float)), sum);
+	}
+
+	// ADDING THE 8 LANES, THEN THE ELEMENTS LEFT
+	__m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+	half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+	float total = _mm_cvtss_f32(half);
+	for (; entry < size; entry++)
+	{
+		total += (float)rowValues[entry] * x[rowCols[entry]];
+	}
+	return total;
+}
+
+// 8 ELEMENTS PER STEP, AS TWO HALVES OF 4 WITH THEIR OWN SUMS SO THAT THE TWO GATHERS OVERLAP
+__attribute__((target("avx2,fma"))) double avx2DotDouble(const int *rowCols, const int *rowValues, long size, const double *x)
+{
+	__m256d sum0 = _mm256_setzero_pd();
+	__m256d sum1 = _mm256_setzero_pd();
+	__m256d allLanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+	long entry = 0;
+	for (; entry + 8 <= size; entry += 8)
+	{
+		__m128i cols0 = _mm_loadu_si128((const __m128i *)(rowCols + entry));
+		__m128i cols1 = _mm_loadu_si128((const __m128i *)(rowCols + entry + 4));
+		__m256d values0 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(rowValues + entry)));
+		__m256d values1 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(rowValues + entry + 4)));
+		sum0 = _mm256_fmadd_pd(values0, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), x, cols0, allLanes, sizeof(double)), sum0);
+		sum1 = _mm256_fmadd_pd(values1, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), x, cols1, allLanes, sizeof(double)), sum1);
+	}
+	if (entry + 4 <= size)
+	{
+		__m128i cols0 = _mm_loadu_si128((const __m128i *)(rowCols + entry));
+		__m256d values0 = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(rowValues + entry)));
+		sum0 = _mm256_fmadd_pd(values0, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), x, cols0, allLanes, sizeof(double)), sum0);
+		entry += 4;
+	}
+
+	__m256d sum = _mm256_add_pd(sum0, sum1);
+	__m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+	half = _mm_add_sd(half, _mm_unpackhi_pd(half, half));
+	double total = _mm_cvtsd_f64(half);
+	for (; entry < size; entry++)
+	{
+		total += (double)rowValues[entry] * x[rowCols[entry]];
+	}
+	return total;
+}
+
+// 8 ELEMENTS PER STEP. THE PRODUCTS AND SUMS WRAP AROUND ON OVERFLOW
+__attribute__((target("avx2"))) int avx2DotInt(const int *rowCols, const int *rowValues, long size, const int *x)
+{
+	__m256i sum = _mm256_setzero_si256();
+	__m256i allLanes = _mm256_set1_epi32(-1);
+	long entry = 0;
+	for (; entry + 8 <= size; entry += 8)
+	{
+		__m256i cols = _mm256_loadu_si256((const __m256i *)(rowCols + entry));
+		__m256i values = _mm256_loadu_si256((const __m256i *)(rowValues + entry));
+		sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(values, _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), x, cols, allLanes, sizeof(int))));
+	}
+
+	__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+	unsigned int total = (unsigned int)_mm_cvtsi128_si32(half);
+	for (; entry < size; entry++)
+	{
+		total += (unsigned int)rowValues[entry] * (unsigned int)x[rowCols[entry]];
+	}
+	return (int)total;
+}
+
+// TILES OF 4 REGISTERS: 32 float, 16 double OR 32 int OUTPUTS ARE ADDED IN REGISTERS WHILE THE SPARSE ROW IS WALKED
+__attribute__((target("avx2,fma"))) void avx2BlockFloat(const int *rowCols, const int *rowValues, long size, const float *X, int numVectors, float *yRow)
+{
+	int tile = 0;
+	for (; tile + 32 <= numVectors; tile += 32)
+	{
+		__m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps(), sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+		for (long entry = 0; entry < size; entry++)
+		{
+			__m256 value = _mm256_set1_ps((float)rowValues[entry]);
+			const float *xRow = X + (size_t)rowCols[entry] * numVectors + tile;
+			sum0 = _mm256_fmadd_ps(value, _mm256_loadu_ps(xRow), sum0);
+			sum1 = _mm256_fmadd_ps(value, _mm256_loadu_ps(xRow + 8), sum1);
+			sum2 = _mm256_fmadd_ps(value, _mm256_loadu_ps(xRow + 16), sum2);
+			sum3 = _mm256_fmadd_ps(value, _mm256_loadu_ps(xRow + 24), sum3);
+		}
+		_mm256_storeu_ps(yRow + tile, sum0);
+		_mm256_storeu_ps(yRow + tile + 8, sum1);
+		_mm256_storeu_ps(yRow + tile + 16, sum2);
+		_mm256_storeu_ps(yRow + tile + 24, sum3);
+	}
+	for (; tile + 8 <= numVectors; tile += 8)
+	{
+		__m256 sum = _mm256_setzero_ps();
+		for (long entry = 0; entry < size; entry++)
+		{
+			const float *xRow = X + (size_t)rowCols[entry] * numVectors + tile;
+			sum = _mm256_fmadd_ps(_mm256_set1_ps((float)rowValues[entry]), _mm256_loadu_ps(xRow), sum);
+		}
+		_mm256_storeu_ps(yRow + tile, sum);
+	}
+	if (tile < numVectors)
+	{
+		scalarBlockRow(rowCols, rowValues, size, X, numVectors, tile, yRow);
+	}
+}
+
+__attribute__((target("avx2,fma"))) void avx2BlockDouble(const int *rowCols, const int *rowValues, long size, const double *X, int numVectors, double *yRow)
+{
+	int tile = 0;
+	for (; tile + 16 <= numVectors; tile += 16)
+	{
+		__m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd(), sum2 = _mm256_setzero_pd(), sum3 = _mm256_setzero_pd();
+		for (long entry = 0; entry < size; entry++)
+		{
+			__m256d value = _mm256_set1_pd((double)rowValues[entry]);
+			const double *xRow = X + (size_t)rowCols[entry] * numVectors + tile;
+			sum0 = _mm256_fmadd_pd(value, _mm256_loadu_pd(xRow), sum0);
+			sum1 = _mm256_fmadd_pd(value, _mm256_loadu_pd(xRow + 4), sum1);
+			sum2 = _mm256_fmadd_pd(value, _mm256_loadu_pd(xRow + 8), sum2);
+			sum3 = _mm256_fmadd_pd(value, _mm256_loadu_pd(xRow + 12), sum3);
+		}
+		_mm256_storeu_pd(yRow + tile, sum0);
+		_mm256_storeu_pd(yRow + tile + 4, sum1);
+		_mm256_storeu_pd(yRow + tile + 8, sum2);
+		_mm256_storeu_pd(yRow + tile + 12, sum3);
+	}
+	for (; tile + 4 <= numVectors; tile += 4)
+	{
+		__m256d sum = _mm256_setzero_pd();
+		for (long entry = 0; entry < size; entry++)
+		{
+			const double *xRow = X + (size_t)rowCols[entry] * numVectors + tile;
+			sum = _mm256_fmadd_pd(_mm256_set1_pd((double)rowValues[entry]), _mm256_loadu_pd(xRow), sum);
+		}
+		_mm256_storeu_pd(yRow + tile, sum);
+	}
+	if (tile < numVectors)
+	{
+		scalarBlockRow(rowCols, rowValues, size, X, numVectors, tile, yRow);
+	}
+}
+
+// THE PRODUCTS AND SUMS WRAP AROUND ON OVERFLOW
+__attribute__((target("avx2"))) void avx2BlockInt(const int *rowCols, const int *rowValues, long size, const int *X, int numVectors, int *yRow)
+{
+	int tile = 0;
+	for (; tile + 32 <= numVectors; tile += 32)
+	{
+		__m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256(), sum2 = _mm256_setzero_si256(), sum3 = _mm256_setzero_si256();
+		for (long entry = 0; entry < size; entry++)
+		{
+			__m256i value = _mm256_set1_epi32(rowValues[entry]);
+			const __m256i *xRow = (const __m256i *)(X + (size_t)rowCols[entry] * numVectors + tile);
+			sum0 = _mm256_add_epi32(sum0, _mm256_mullo_epi32(value, _mm256_loadu_si256(xRow)));
+			sum1 = _mm256_add_epi32(sum1, _mm256_mullo_epi32(value, _mm256_loadu_si256(xRow + 1)));
+			sum2 = _mm256_add_epi32(sum2, _mm256_mullo_epi32(value, _mm256_loadu_si256(xRow + 2)));
+			sum3 = _mm256_add_epi32(sum3, _mm256_mullo_epi32(value, _mm256_loadu_si256(xRow + 3)));
+		}
+		__m256i *out = (__m256i *)(yRow + tile);
+		_mm256_storeu_si256(out, sum0);
+		_mm256_storeu_si256(out + 1, sum1);
+		_mm256_storeu_si256(out + 2, sum2);
+		_mm256_storeu_si256(out + 3, sum3);
+	}
+	for (; tile + 8 <= numVectors; tile += 8)
+	{
+		__m256i sum = _mm256_setzero_si256();
+		for (long entry = 0; entry < size; entry++)
+		{
+			const __m256i *xRow = (const __m256i *)(X + (size_t)rowCols[entry] * numVectors + tile);
+			sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(_mm256_set1_epi32(rowValues[entry]), _mm256_loadu_si256(xRow)));
+		}
+		_mm256_storeu_si256((__m256i *)(yRow + tile), sum);
+	}
+
+	if (tile < numVectors)
+	{
+		scalarBlockRow(rowCols, rowValues, size, X, numVectors, tile, yRow);
+	}
+}
+
+#endif
+
+DotKernel<int> chooseDotKernel(const int *)
+{
+#ifdef HAVE_AVX2_KERNELS
+	if (cpuHasAVX2())
+	{
+		return avx2DotInt;
+	}
+#endif
+	return scalarDot<int>;
+}
+
+// THERE IS NO 64-BIT MULTIPLICATION IN AVX2, SO long ALWAYS USES THE PLAIN LOOP
+DotKernel<long> chooseDotKernel(const long *)
+{
+	return scalarDot<long>;
+}
+
+DotKernel<float> chooseDotKernel(const float *)
+{
+#ifdef HAVE_AVX2_KERNELS
+	if (cpuHasAVX2())
+	{
+		return avx2DotFloat;
+	}
+#endif
+	return scalarDot<float>;
+}
+
+DotKernel<double> chooseDotKernel(const double *)
+{
+#ifdef HAVE_AVX2_KERNELS
+	if (cpuHasAVX2())
+	{
+		return avx2DotDouble;
+	}
+#endif
+	return scalarDot<double>;
+}
+
+BlockKernel<int> chooseBlockKernel(const int *)
+{
+#ifdef HAVE_AVX2_KERNELS
+	if (cpuHasAVX2())
+	{
+		return avx2BlockInt;
+	}
+#endif
+	return scalarBlock<int>;
+}
+
+BlockKernel<long> chooseBlockKernel(const long *)
+{
+	return scalarBlock<long>;
+}
+
+BlockKernel<float> chooseBlockKernel(const float *)
+{
+#ifdef HAVE_AVX2_KERNELS
+	if (cpuHasAVX2())
+	{
+		return avx2BlockFloat;
+	}
+#endif
+	return scalarBlock<float>;
+}
+
+BlockKernel<double> chooseBlockKernel(const double *)
+{
+#ifdef HAVE_AVX2_KERNELS
+	if (cpuHasAVX2())
+	{
+		return avx2BlockDouble;
+	}
+#endif
+	return scalarBlock<double>;
+}
@@ -0,0 +1,45 @@
+#ifndef VECTORKERNELS_H_
+#define VECTORKERNELS_H_
+
+/**
+ * Kernel computing the dot product of one sparse row (size elements with the
+ * columns rowCols and the values rowValues) with a dense vector x.
+ */
+template <typename T>
+using DotKernel = T (*)(const int *rowCols, const int *rowValues, long size, const T *x);
+
+/**
+ * Returns the fastest dot product kernel for the type of x on this processor.
+ * On x86 processors with AVX2, the int, float and double kernels load 8 or 4
+ * elements of x at a time with gather instructions; otherwise, and for long,
+ * the kernel is a plain loop. Floating-point sums are added in a different
+ * order by the AVX2 kernels, so their results can differ in the last bits.
+ * Integer sums wrap around on overflow, in every kernel.
+ */
+DotKernel<int> chooseDotKernel(const int *x);
+DotKernel<long> chooseDotKernel(const long *x);
+DotKernel<float> chooseDotKernel(const float *x);
+DotKernel<double> chooseDotKernel(const double *x);
+
+/**
+ * Kernel computing one row of the product of a sparse matrix by a dense block
+ * of numVectors vectors: yRow = the sum over the elements of the sparse row of
+ * value * (row col of X), where X is stored row-major with numVectors values
+ * per row. The sparse row is read once for all the vectors.
+ */
+template <typename T>
+using BlockKernel = void (*)(const int *rowCols, const int *rowValues, long size, const T *X, int numVectors, T *yRow);
+
+/**
+ * Returns the fastest block kernel for the type of X on this processor. On x86
+ * processors with AVX2, the int, float and double kernels keep a tile of 16 to
+ * 32 outputs in registers while they walk the sparse row, with one broadcast
+ * and one vector multiply-add per element and register of the tile; the
+ * outputs after the last full tile use a plain loop.
+ */
+BlockKernel<int> chooseBlockKernel(const int *X);
+BlockKernel<long> chooseBlockKernel(const long *X);
+BlockKernel<float> chooseBlockKernel(const float *X);
+BlockKernel<double> chooseBlockKernel(const double *X);
+
+#endif /* VECTORKERNELS_H_ */
@@ -0,0 +1,309 @@
+#include "WorkScheduler.h"
+#include <algorithm>
+#include <thread>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+// NUMBER OF CHUNKS MADE FOR EVERY WORKER: ENOUGH FOR THE WORKERS THAT FINISH FIRST TO HAVE SOMETHING TO STEAL,
+// FEW ENOUGH THAT TAKING A CHUNK COSTS NOTHING NEXT TO THE WORK IN IT
+const int CHUNKS_PER_WORKER = 16;
+
+// RUNNING THE WORKERS ON NEW THREADS, WHEN THE POOL IS ALREADY BUSY
+void runOnNewThreads(int numWorkers, const function<void(int)> &work)
+{
+	exception_ptr firstError;
+	mutex errorMutex;
+	auto runWorker = [&](int worker)
+	{
+		try
+		{
+			work(worker);
+		}
+		catch (...)
+		{
+			lock_guard<mutex> lock(errorMutex);
+			if (!firstError)
+			{
+				firstError = current_exception();
+			}
+		}
+	};
+
+	vector<thread> threads;
+	for (int worker = 1; worker < numWorkers; worker++)
+	{
+		threads.push_back(thread(runWorker, worker));
+	}
+	runWorker(0);
+	for (size_t t = 0; t < threads.size(); t++)
+	{
+		threads[t].join();
+	}
+	if (firstError)
+	{
+		rethrow_exception(firstError);
+	}
+}
+
+// TRUE ON THE THREADS OF THE POOL AND ON A THREAD WHILE IT RUNS A JOB ON THE POOL
+thread_local bool insidePool = false;
+
+// THREADS KEPT FROM ONE CALL OF runInParallel TO THE NEXT, SO THAT A CALL DOES NOT START THREADS OR ALLOCATE
+// ONCE THE POOL HAS ENOUGH OF THEM. THREAD t OF THE POOL RUNS WORKER t + 1 OF A JOB, AND THE CALLING THREAD WORKER 0
+class WorkerPool
+{
+private:
+	mutex runMutex; // HELD WHILE A JOB RUNS ON THE POOL
+	mutex stateMutex;
+	condition_variable jobReady;
+	condition_variable jobDone;
+	vector<thread> threads;
+	bool stopping;
+
+	// THE CURRENT JOB, A NEW ONE STARTING WHENEVER generation CHANGES
+	const function<void(int)> *job;
+	int jobWorkers;
+	unsigned long generation;
+	int pending; // WORKERS OF THE POOL THAT HAVE NOT FINISHED THE JOB
+	exception_ptr firstError;
+
+	void threadLoop(int worker, unsigned long seen)
+	{
+		insidePool = true;
+		unique_lock<mutex> lock(stateMutex);
+		while (true)
+		{
+			jobReady.wait(lock, [&]
+						  { return stopping || generation != seen; });
+			if (stopping)
+			{
+				return;
+			}
+			seen = generation;
+			if (worker >= jobWorkers)
+			{
+				continue;
+			}
+
+			lock.unlock();
+			exception_ptr error;
+			try
+			{
+				(*job)(worker);
+			}
+			catch (...)
+			{
+				error = current_exception();
+			}
+			lock.lock();
+
+			if (error && !firstError)
+			{
+				firstError = error;
+			}
+			if (--pending == 0)
+			{
+				jobDone.notify_one();
+			}
+		}
+	}
+
+public:
+	WorkerPool()
+	{
+		stopping = false;
+		job = NULL;
+		jobWorkers = 0;
+		generation = 0;
+		pending = 0;
+	}
+
+	~WorkerPool()
+	{
+		{
+			lock_guard<mutex> lock(stateMutex);
+			stopping = true;
+		}
+		jobReady.notify_all();
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			threads[t].join();
+		}
+	}
+
+	// RUNS THE JOB ON THE POOL AND RETURNS TRUE, OR RETURNS FALSE WITHOUT RUNNING IT IF ANOTHER THREAD IS USING THE POOL
+	bool run(int numWorkers, const function<void(int)> &work)
+	{
+		unique_lock<mutex> runLock(runMutex, try_to_lock);
+		if (!runLock.owns_lock())
+		{
+			return false;
+		}
+
+		// STARTING THE THREADS THE POOL DOES NOT HAVE YET. THEY START AT THE CURRENT GENERATION, SO THEY WAIT FOR THE NEXT JOB
+		while ((int)threads.size() < numWorkers - 1)
+		{
+			threads.push_back(thread(&WorkerPool::threadLoop, this, (int)threads.size() + 1, generation));
+		}
+
+		{
+			lock_guard<mutex> lock(stateMutex);
+			job = &work;
+			jobWorkers = numWorkers;
+			pending = numWorkers - 1;
+			firstError = NULL;
+			generation++;
+		}
+		jobReady.notify_all();
+
+		exception_ptr error;
+		insidePool = true;
+		try
+		{
+			work(0);
+		}
+		catch (...)
+		{
+			error = current_exception();
+		}
+		insidePool = false;
+
+		unique_lock<mutex> lock(stateMutex);
+		jobDone.wait(lock, [&]
+					 { return pending == 0; });
+		if (!error)
+		{
+			error = firstError;
+		}
+		firstError = NULL;
+		lock.unlock();
+		if (error)
+		{
+			rethrow_exception(error);
+		}
+		return true;
+	}
+};
+
+void runInParallel(int numWorkers, const function<void(int)> &work)
+{
+	if (numWorkers <= 1)
+	{
+		work(0);
+		return;
+	}
+
+	// A WORKER THAT RUNS WORK IN PARALLEL ITSELF, OR A SECOND THREAD CALLING AT THE SAME TIME, GETS NEW THREADS
+	static WorkerPool pool;
+	if (insidePool || !pool.run(numWorkers, work))
+	{
+		runOnNewThreads(numWorkers, work);
+	}
+}
+
+// PACKING THE FIRST AND ONE PAST THE LAST CHUNK OF A SHARE INTO ONE VALUE
+unsigned long long packShare(int first, int last)
+{
+	return ((unsigned long long)(unsigned int)first << 32) | (unsigned int)last;
+}
+
+WorkScheduler::WorkScheduler(const long *workPrefix, int numItems, int numWorkers)
+	: numWorkers(max(1, numWorkers)), shares(max(1, numWorkers))
+{
+	// CUTTING THE ITEMS WHERE THE PREFIX SUM OF THE WORK CROSSES EVERY MULTIPLE OF totalWork / maxChunks.
+	// AN ITEM WITH MORE WORK THAN THAT ENDS UP ALONE IN ITS CHUNK, AND CUTS THAT FALL ON THE SAME ITEM ARE MERGED
+	chunkStarts.push_back(0);
+	if (numItems > 0)
+	{
+		long totalWork = workPrefix[numItems] - workPrefix[0];
+		int maxChunks = (int)min((long)numItems, (long)this->numWorkers * CHUNKS_PER_WORKER);
+		for (int k = 1; k < maxChunks; k++)
+		{
+			long cut = workPrefix[0] + totalWork / maxChunks * k + totalWork % maxChunks * k / maxChunks;
+			int item = (int)(lower_bound(workPrefix, workPrefix + numItems + 1, cut) - workPrefix);
+			if (item > chunkStarts.back() && item < numItems)
+			{
+				chunkStarts.push_back(item);
+			}
+		}
+		chunkStarts.push_back(numItems);
+	}
+
+	reset();
+}
+
+// GIVING EVERY WORKER THE SAME NUMBER OF CONSECUTIVE CHUNKS, AND SO ABOUT THE SAME AMOUNT OF WORK
+void WorkScheduler::reset()
+{
+	int numChunks = getNumChunks();
+	for (int worker = 0; worker < numWorkers; worker++)
+	{
+		int first = (int)((long)numChunks * worker / numWorkers);
+		int last = (int)((long)numChunks * (worker + 1) / numWorkers);
+		shares[worker].store(packShare(first, last));
+	}
+}
+
+int WorkScheduler::getNumWorkers() const
+{
+	return numWorkers;
+}
+
+int WorkScheduler::getNumChunks() const
+{
+	return (int)chunkStarts.size() - 1;
+}
+
+int WorkScheduler::chunkStart(int chunk) const
+{
+	return chunkStarts[chunk];
+}
+
+// TAKING ONE CHUNK FROM THE SHARE OF A WORKER: THE OWNER TAKES FROM THE FRONT AND THE OTHER WORKERS
+// FROM THE BACK, SO THE OWNER KEEPS WALKING ITS ROWS IN ORDER
+bool WorkScheduler::takeChunk(int victim, bool fromFront, int &chunk)
+{
+	unsigned long long share = shares[victim].load();
+	while (true)
+	{
+		int first = (int)(share >> 32);
+		int last = (int)(share & 0xFFFFFFFFULL);
+		if (first >= last)
+		{
+			return false;
+		}
+
+		unsigned long long remaining = fromFront ? packShare(first + 1, last) : packShare(first, last - 1);
+		if (shares[victim].compare_exchange_weak(share, remaining))
+		{
+			chunk = fromFront ? first : last - 1;
+			return true;
+		}
+	}
+}
+
+bool WorkScheduler::nextChunk(int worker, int &chunk)
+{
+	if (takeChunk(worker, true, chunk))
+	{
+		return true;
+	}
+
+	// STEALING FROM THE OTHER WORKERS, STARTING WITH THE NEXT ONE. SHARES ONLY GET SMALLER, SO ONE
+	// ROUND OVER THE OTHER WORKERS IS ENOUGH TO KNOW THAT EVERY CHUNK HAS BEEN TAKEN
+	for (int offset = 1; offset < numWorkers; offset++)
+	{
+		if (takeChunk((worker + offset) % numWorkers, false, chunk))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkScheduler::run(const function<void(int)> &work)
+{
+	runInParallel(numWorkers, work);
+}
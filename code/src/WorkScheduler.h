@@ -0,0 +1,92 @@
+#ifndef WORKSCHEDULER_H_
+#define WORKSCHEDULER_H_
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+/**
+ * Runs work(0) .. work(numWorkers - 1) on numWorkers threads (the calling
+ * thread runs work(0)) and waits for all of them. If a worker throws, the
+ * first exception is thrown again on the calling thread once all the
+ * workers are done.
+ *
+ * The other threads come from a pool that keeps them waiting between calls,
+ * so a call only starts threads (and allocates) when the pool has fewer than
+ * numWorkers - 1 of them. A call made by a worker, or made while another
+ * thread is using the pool, runs on new threads instead.
+ */
+void runInParallel(int numWorkers, const std::function<void(int)> &work);
+
+/**
+ * Splits a range of items (the rows of a matrix) into chunks that hold about
+ * the same amount of work, and hands the chunks out to a number of workers.
+ *
+ * The work of the items is given as a prefix sum: workPrefix[i] is the work of
+ * items 0 .. i-1, so a row holding most of the non-zeros gets a chunk of its
+ * own while long runs of empty rows are grouped together. Every worker starts
+ * with its own contiguous share of the chunks; once its share is done it
+ * steals the remaining chunks from the end of the shares of the other workers,
+ * so no thread sits idle while another one still has chunks left.
+ *
+ * A kernel runs the scheduler with run(), and every worker asks for chunks
+ * with nextChunk() until there are none left:
+ *
+ *     scheduler.run([&](int worker)
+ *     {
+ *         int chunk;
+ *         while (scheduler.nextChunk(worker, chunk))
+ *         {
+ *             for (int i = scheduler.chunkStart(chunk); i < scheduler.chunkStart(chunk + 1); i++) ...
+ *         }
+ *     });
+ */
+class WorkScheduler
+{
+private:
+	int numWorkers;
+	std::vector<int> chunkStarts; // FIRST ITEM OF EVERY CHUNK, AND THE NUMBER OF ITEMS AT THE END
+
+	// CHUNKS NOT YET TAKEN FROM THE SHARE OF EVERY WORKER, THE FIRST ONE IN THE HIGH 32 BITS AND
+	// ONE PAST THE LAST ONE IN THE LOW 32 BITS, SO THAT BOTH ENDS ARE UPDATED WITH ONE ATOMIC OPERATION
+	std::vector<std::atomic<unsigned long long> > shares;
+
+	bool takeChunk(int victim, bool fromFront, int &chunk);
+
+public:
+	/**
+	 * Splits numItems items, with the work given by the prefix sum workPrefix
+	 * (numItems + 1 values), into chunks for numWorkers workers.
+	 */
+	WorkScheduler(const long *workPrefix, int numItems, int numWorkers);
+
+	int getNumWorkers() const;
+	int getNumChunks() const;
+
+	/**
+	 * Returns the first item of a chunk. The items of the chunk are
+	 * chunkStart(chunk) .. chunkStart(chunk + 1) - 1, and the chunks are
+	 * numbered in the order of their items.
+	 */
+	int chunkStart(int chunk) const;
+
+	/**
+	 * Takes the next chunk for a worker: the next one of its own share, or one
+	 * stolen from another worker once its own share is done. Returns false
+	 * when every chunk has been taken.
+	 */
+	bool nextChunk(int worker, int &chunk);
+
+	/**
+	 * Hands out all the chunks again, in the same shares as after the constructor,
+	 * so that the same split can be run again without being computed again.
+	 */
+	void reset();
+
+	/**
+	 * Runs work(worker) for every worker on its own thread and waits for all of them.
+	 */
+	void run(const std::function<void(int)> &work);
+};
+
+#endif /* WORKSCHEDULER_H_ */
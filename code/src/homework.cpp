@@ -7,15 +7,121 @@
 
 #include "homework.h"
 
+/**
+ * Results are written in the Matrix Market format when the output path ends
+ * with .mtx, and in the rows=/cols= text format otherwise.
+ */
+bool isMatrixMarketPath(const char *outputPath) {
+	size_t length = strlen(outputPath);
+	return length >= 4 && strcmp(outputPath + length - 4, ".mtx") == 0;
+}
+
+void writeOutput(SparseMatrix &matrix, char *outputPath) {
+	if (isMatrixMarketPath(outputPath))
+		matrix.writeMatrixMarketFile(outputPath);
+	else
+		matrix.printToASCIIFile(outputPath);
+}
+
+/**
+ * Reads a size in bytes, or in KB, MB or GB with a K, M or G suffix.
+ * Returns -1 if the text is not a size.
+ */
+long long parseSize(const char *text) {
+	char *suffix;
+	long long size = strtoll(text, &suffix, 10);
+	if (suffix == text) return -1;
+	if (*suffix == 'K' || *suffix == 'k') size <<= 10;
+	else if (*suffix == 'M' || *suffix == 'm') size <<= 20;
+	else if (*suffix == 'G' || *suffix == 'g') size <<= 30;
+	else if (*suffix != '\0') return -1;
+	return size;
+}
+
 int main(int argc, char** argv) {
 	LogManager::resetLogFile();
 	LogManager::writePrintfToLog(LogManager::Level::Status, "main", "In main file.");
+
+	/**
+	 * Options start with "--" and can be given anywhere on the command line.
+	 * They are removed from argv so that the positional arguments keep their place.
+	 */
+	int numArgs = 0;
+	bool stream = false;
+	long long memoryBudget = 0;
+	for (int i = 0; i < argc; i++){
+		if (strncmp(argv[i], "--threads=", 10) == 0){
+			int numThreads = atoi(argv[i] + 10);
+			if (numThreads <= 0){
+				printf("--threads must be a positive number\n");
+				return -1;
+			}
+			SparseMatrix::setNumThreads(numThreads);
+			continue;
+		}
+		if (strncmp(argv[i], "--memory-budget=", 16) == 0){
+			memoryBudget = parseSize(argv[i] + 16);
+			if (memoryBudget <= 0){
+				printf("--memory-budget must be a size such as 500000, 64M or 2G\n");
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--stream") == 0){
+			stream = true;
+			continue;
+		}
+		if (strcmp(argv[i], "--cache") == 0){
+			MatrixFileCache::setEnabled(true);
+			continue;
+		}
+		if (strncmp(argv[i], "--cache-dir=", 12) == 0){
+			MatrixFileCache::setEnabled(true);
+			MatrixFileCache::setDirectory(argv[i] + 12);
+			continue;
+		}
+		if (strncmp(argv[i], "--cache-max-size=", 17) == 0){
+			long long maxSize = parseSize(argv[i] + 17);
+			if (maxSize < 0){
+				printf("--cache-max-size must be a size such as 500000, 64M or 2G\n");
+				return -1;
+			}
+			MatrixFileCache::setMaxSize(maxSize);
+			continue;
+		}
+		if (strncmp(argv[i], "--cache-verify=", 15) == 0){
+			if (strcmp(argv[i] + 15, "hash") != 0 && strcmp(argv[i] + 15, "stat") != 0){
+				printf("--cache-verify must be hash or stat\n");
+				return -1;
+			}
+			MatrixFileCache::setVerifyContent(strcmp(argv[i] + 15, "hash") == 0);
+			continue;
+		}
+		if (strcmp(argv[i], "--cache-refresh") == 0){
+			MatrixFileCache::setRefresh(true);
+			continue;
+		}
+		argv[numArgs++] = argv[i];
+	}
+	argc = numArgs;
+
 	if (argc < 4){
 		printf("Usage:\n\n");
 		printf("./homework addn pathToMatrix1   pathToMatrix2 outputPath\n\n");
 		printf("./homework mult pathToMatrix1   pathToMatrix2 outputPath\n\n");
 		printf("./homework subt pathToMatrix1   pathToMatrix2 outputPath\n\n");
 		printf("./homework check pathToMatrix1  outputPath\n\n");
+		printf("./homework binary pathToMatrix1 outputPath\n\n");
+		printf("Inputs can be text, Matrix Market (.mtx coordinate) or binary files. An outputPath ending with .mtx is written in the Matrix Market format.\n\n");
+		printf("Options:\n\n");
+		printf("--threads=N  number of threads used by the matrix operations (default: number of cores)\n");
+		printf("--stream  addn and subt read the inputs row by row and write the result as it goes, without loading them (the inputs must be ordered by row)\n");
+		printf("--memory-budget=SIZE  mult reads the inputs row by row and computes the product in blocks that fit in about SIZE bytes (e.g. 4G)\n\n");
+		printf("--cache  keep a binary copy of every text input (input.txt.smbin) and load it while the input is unchanged\n");
+		printf("--cache-dir=DIR  keep the binary copies in DIR instead of next to the inputs (implies --cache)\n");
+		printf("--cache-max-size=SIZE  largest binary copy, and in a cache directory the largest total (e.g. 512M)\n");
+		printf("--cache-verify=hash|stat  check the size, time and content of an input (hash, default) or only its size and time (stat)\n");
+		printf("--cache-refresh  ignore the existing binary copies and write them again\n\n");
 		return 0;
 	}
 
@@ -56,7 +162,15 @@ int main(int argc, char** argv) {
 			 * is loaded properly from text file and written properly to
 			 * a text file.
 			 */
-			matrix1.printToASCIIFile(output);
+			writeOutput(matrix1, output);
+		}
+		if (strcmp(argv[1], "binary") == 0){
+			/**
+			 * This command line argument is used to convert a matrix
+			 * to the binary format, which every command can read
+			 * in place of a text file without parsing it.
+			 */
+			matrix1.writeBinaryFile(output);
 		}
 	}
 
@@ -78,40 +192,61 @@ int main(int argc, char** argv) {
 			printf("allocation of outputPath failed\n");
 			return -1;
 		}
-		SparseMatrix matrix1(path1);
-		SparseMatrix matrix2(path2);
-		if (strcmp(argv[1], "addn") == 0){
+		if (stream && strcmp(argv[1], "addn") == 0){
 			/**
-			 * This command line argument is used to check
-			 * addition of two matrices.
+			 * Addition of two matrices that are never loaded.
 			 */
-			SparseMatrix newMat = matrix1 + matrix2;
-			newMat.printToASCIIFile(output);
+			SparseMatrix::addFiles(path1, path2, output, isMatrixMarketPath(output));
 		}
-		if (strcmp(argv[1], "subt") == 0){
+		else if (stream && strcmp(argv[1], "subt") == 0){
 			/**
-			 * This command line argument is used to check
-			 * subtraction of two matrices.
+			 * Subtraction of two matrices that are never loaded.
 			 */
-			SparseMatrix newMat = matrix1 - matrix2;
-			newMat.printToASCIIFile(output);
+			SparseMatrix::subtractFiles(path1, path2, output, isMatrixMarketPath(output));
 		}
-		if (strcmp(argv[1], "mult") == 0){
+		else if (memoryBudget > 0 && strcmp(argv[1], "mult") == 0){
 			/**
-			 * This command line argument is used to check
-			 * multiplication of two matrices.
+			 * Multiplication of two matrices that are never loaded,
+			 * in blocks that fit in the memory budget.
 			 */
-			SparseMatrix newMat = matrix1 * matrix2;
-			newMat.printToASCIIFile(output);
+			SparseMatrix::multiplyFiles(path1, path2, output, memoryBudget, isMatrixMarketPath(output));
 		}
-		if (strcmp(argv[1], "check") == 0){
-			/**
-			 * This command line argument is used to check
-			 * multiplication of two matrices.
-			 */
-			// SparseMatrix newMat = matrix1 * matrix2;
-			printf("SparseMatrix::SparseMatrix(char *matrixFilePath)");
-			matrix1.printToASCIIFile(output);
+		else {
+			SparseMatrix matrix1(path1);
+			SparseMatrix matrix2(path2);
+			if (strcmp(argv[1], "addn") == 0){
+				/**
+				 * This command line argument is used to check
+				 * addition of two matrices.
+				 */
+				SparseMatrix newMat = matrix1 + matrix2;
+				writeOutput(newMat, output);
+			}
+			if (strcmp(argv[1], "subt") == 0){
+				/**
+				 * This command line argument is used to check
+				 * subtraction of two matrices.
+				 */
+				SparseMatrix newMat = matrix1 - matrix2;
+				writeOutput(newMat, output);
+			}
+			if (strcmp(argv[1], "mult") == 0){
+				/**
+				 * This command line argument is used to check
+				 * multiplication of two matrices.
+				 */
+				SparseMatrix newMat = matrix1 * matrix2;
+				writeOutput(newMat, output);
+			}
+			if (strcmp(argv[1], "check") == 0){
+				/**
+				 * This command line argument is used to check
+				 * multiplication of two matrices.
+				 */
+				// SparseMatrix newMat = matrix1 * matrix2;
+				printf("SparseMatrix::SparseMatrix(char *matrixFilePath)");
+				writeOutput(matrix1, output);
+			}
 		}
 	}
 
@@ -16,5 +16,6 @@
 #include "util/GetMemUsage.h"
 #include "util/LogManager.h"
 #include "SparseMatrix.h"
+#include "MatrixFileCache.h"
 
 #endif /* BITVECTOR_SRC_HOMEWORK_H_ */
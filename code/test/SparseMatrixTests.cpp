@@ -0,0 +1,917 @@
+/*
+ * SparseMatrixTests.cpp
+ *
+ * Checks the matrix operations against the outputs stored in sample_input and against
+ * small matrices kept in a std::map, which is the reference implementation of every test.
+ *
+ * Usage: ./SparseMatrixTests pathToSampleInput workDirectory
+ */
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/SparseMatrix.h"
+#include "../src/MatrixBinaryFormat.h"
+#include "../src/MatrixFileCache.h"
+
+using namespace std;
+
+// ELEMENTS OF A MATRIX BY (ROW, COLUMN), WITHOUT ZEROS
+typedef map<pair<int, int>, int> Reference;
+
+string sampleDirectory;
+string workDirectory;
+int numChecks = 0;
+int numFailures = 0;
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+void check(bool passed, const char *text, int line)
+{
+	numChecks++;
+	if (!passed)
+	{
+		numFailures++;
+		printf("FAILED line %d: %s\n", line, text);
+	}
+}
+
+// RETURNS TRUE IF function THROWS AN EXCEPTION OF TYPE Exception
+template <typename Exception>
+bool throws(const function<void()> &function)
+{
+	try
+	{
+		function();
+	}
+	catch (const Exception &)
+	{
+		return true;
+	}
+	catch (...)
+	{
+	}
+	return false;
+}
+
+// THE API TAKES char * FILE NAMES
+char *cstr(const string &text)
+{
+	return const_cast<char *>(text.c_str());
+}
+
+string samplePath(const string &name)
+{
+	return sampleDirectory + "/" + name;
+}
+
+string workPath(const string &name)
+{
+	return workDirectory + "/" + name;
+}
+
+string readFile(const string &path)
+{
+	string contents;
+	FILE *stream = fopen(path.c_str(), "rb");
+	if (!stream)
+	{
+		return "<missing " + path + ">";
+	}
+	char buffer[1 << 16];
+	size_t size;
+	while ((size = fread(buffer, 1, sizeof(buffer), stream)) > 0)
+	{
+		contents.append(buffer, size);
+	}
+	fclose(stream);
+	return contents;
+}
+
+void writeFile(const string &path, const string &contents)
+{
+	FILE *stream = fopen(path.c_str(), "wb");
+	fwrite(contents.data(), 1, contents.size(), stream);
+	fclose(stream);
+}
+
+bool sameFiles(const string &path1, const string &path2)
+{
+	return readFile(path1) == readFile(path2);
+}
+
+// THE TEXT printToASCIIFile WRITES FOR A REFERENCE MATRIX
+string referenceText(int rows, int cols, const Reference &elements)
+{
+	string text = "rows=" + to_string(rows) + "\ncols=" + to_string(cols) + "\n";
+	for (Reference::const_iterator element = elements.begin(); element != elements.end(); ++element)
+	{
+		text += "(" + to_string(element->first.first) + ", " + to_string(element->first.second) + ", " + to_string(element->second) + ")\n";
+	}
+	return text;
+}
+
+// READING A rows=/cols= FILE THE WAY THE LOADER DOES: THE LAST VALUE OF A POSITION IS KEPT, A VALUE OF 0 REMOVES
+// THE ELEMENT, AND AN ELEMENT IN COLUMN cols IS SKIPPED
+Reference readReference(const string &path, int &rows, int &cols)
+{
+	Reference elements;
+	FILE *stream = fopen(path.c_str(), "r");
+	if (!stream || fscanf(stream, " rows=%d cols=%d", &rows, &cols) != 2)
+	{
+		rows = cols = -1;
+		return elements;
+	}
+	int row, col, value;
+	while (fscanf(stream, " (%d , %d , %d )", &row, &col, &value) == 3)
+	{
+		if (col == cols)
+		{
+			continue;
+		}
+		if (value == 0)
+		{
+			elements.erase(make_pair(row, col));
+		}
+		else
+		{
+			elements[make_pair(row, col)] = value;
+		}
+	}
+	fclose(stream);
+	return elements;
+}
+
+// PRINTING THE MATRIX AND COMPARING IT WITH THE REFERENCE, WHICH CHECKS THE DIMENSIONS, THE ELEMENTS AND THEIR ORDER
+bool matches(SparseMatrix &matrix, int rows, int cols, const Reference &elements)
+{
+	string path = workPath("matches.txt");
+	matrix.printToASCIIFile(cstr(path));
+	return readFile(path) == referenceText(rows, cols, elements);
+}
+
+Reference randomReference(int rows, int cols, int numElements, unsigned int seed)
+{
+	mt19937 generator(seed);
+	Reference elements;
+	for (int i = 0; i < numElements; i++)
+	{
+		int value = (int)(generator() % 19) - 9;
+		if (value != 0)
+		{
+			elements[make_pair((int)(generator() % rows), (int)(generator() % cols))] = value;
+		}
+	}
+	return elements;
+}
+
+// SETTING THE ELEMENTS ONE BY ONE IN A SHUFFLED ORDER
+SparseMatrix buildMatrix(int rows, int cols, const Reference &elements, unsigned int seed)
+{
+	vector<pair<pair<int, int>, int> > order(elements.begin(), elements.end());
+	shuffle(order.begin(), order.end(), mt19937(seed));
+	SparseMatrix matrix(rows, cols);
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		matrix.setElement(order[i].first.first, order[i].first.second, order[i].second);
+	}
+	return matrix;
+}
+
+Reference referenceSum(const Reference &first, const Reference &second, int sign)
+{
+	Reference sum = first;
+	for (Reference::const_iterator element = second.begin(); element != second.end(); ++element)
+	{
+		int value = (sum[element->first] += sign * element->second);
+		if (value == 0)
+		{
+			sum.erase(element->first);
+		}
+	}
+	return sum;
+}
+
+Reference referenceProduct(const Reference &first, const Reference &second)
+{
+	map<int, vector<pair<int, int> > > secondRows;
+	for (Reference::const_iterator element = second.begin(); element != second.end(); ++element)
+	{
+		secondRows[element->first.first].push_back(make_pair(element->first.second, element->second));
+	}
+	Reference product;
+	for (Reference::const_iterator element = first.begin(); element != first.end(); ++element)
+	{
+		const vector<pair<int, int> > &row = secondRows[element->first.second];
+		for (size_t i = 0; i < row.size(); i++)
+		{
+			product[make_pair(element->first.first, row[i].first)] += element->second * row[i].second;
+		}
+	}
+	for (Reference::iterator element = product.begin(); element != product.end();)
+	{
+		element = element->second == 0 ? product.erase(element) : ++element;
+	}
+	return product;
+}
+
+// THE OPERATIONS ON THE SAMPLE MATRICES GIVE THE OUTPUTS STORED WITH THEM, AND LOADING AND PRINTING A SAMPLE GIVES IT BACK
+void testSampleOutputs()
+{
+	const char *tests[] = {"01", "02", "03", "04"};
+	string output = workPath("sample_output.txt");
+	for (int t = 0; t < 4; t++)
+	{
+		string prefix = samplePath("student/train_") + tests[t];
+		string expected = samplePath("student/output/train_") + tests[t];
+		SparseMatrix matrix1(cstr(prefix + "_1.txt"));
+		SparseMatrix matrix2(cstr(prefix + "_2.txt"));
+		SparseMatrix matrix3(cstr(prefix + "_3.txt"));
+
+		SparseMatrix sum = matrix1 + matrix2;
+		sum.printToASCIIFile(cstr(output));
+		CHECK(sameFiles(output, expected + "_1_add_2.txt"));
+
+		SparseMatrix difference = matrix1 - matrix2;
+		difference.printToASCIIFile(cstr(output));
+		CHECK(sameFiles(output, expected + "_1_subt_2.txt"));
+
+		SparseMatrix product = matrix1 * matrix3;
+		product.printToASCIIFile(cstr(output));
+		CHECK(sameFiles(output, expected + "_1_mul_3.txt"));
+
+		matrix1.printToASCIIFile(cstr(output));
+		CHECK(sameFiles(output, prefix + "_1.txt"));
+	}
+}
+
+// THE EASY SAMPLES HAVE ELEMENTS IN COLUMN cols, WHICH ARE SKIPPED, AND ELEMENTS SET TO 0 AFTER A VALUE
+void testEasySamples()
+{
+	const char *samples[] = {"easy_sample_01_3.txt", "easy_sample_03_3.txt"};
+	for (int s = 0; s < 2; s++)
+	{
+		int rows, cols;
+		Reference elements = readReference(samplePath(samples[s]), rows, cols);
+		SparseMatrix matrix(cstr(samplePath(samples[s])));
+		CHECK(matches(matrix, rows, cols, elements));
+	}
+}
+
+// A FROZEN MATRIX HAS THE SAME ELEMENTS, AND setElement ON IT GOES BACK TO THE ROW TREES
+void testFreeze()
+{
+	Reference elements = randomReference(50, 40, 600, 1);
+	SparseMatrix matrix = buildMatrix(50, 40, elements, 2);
+	CHECK(!matrix.isFrozen());
+	matrix.freeze();
+	CHECK(matrix.isFrozen());
+	CHECK(matches(matrix, 50, 40, elements));
+	for (Reference::iterator element = elements.begin(); element != elements.end(); ++element)
+	{
+		CHECK(matrix.getElement(element->first.first, element->first.second) == element->second);
+	}
+
+	CHECK(matrix.setElement(3, 7, 11) == 1);
+	elements[make_pair(3, 7)] = 11;
+	CHECK(!matrix.isFrozen());
+	CHECK(matches(matrix, 50, 40, elements));
+	matrix.freeze();
+	CHECK(matches(matrix, 50, 40, elements));
+
+	CHECK(throws<invalid_argument>([&]() { matrix.setElement(50, 0, 1); }));
+	CHECK(throws<invalid_argument>([&]() { matrix.setElement(0, 40, 1); }));
+	CHECK(throws<invalid_argument>([&]() { matrix.setElement(-1, 0, 1); }));
+	CHECK(throws<invalid_argument>([&]() { matrix.getElement(0, 40); }));
+}
+
+// ELEMENTS INSERTED IN INCREASING, DECREASING AND RANDOM COLUMN ORDER, WHICH WOULD BE QUADRATIC WITHOUT BALANCING
+void testBalancedRows()
+{
+	const int cols = 200000;
+	SparseMatrix matrix(3, cols);
+	Reference elements;
+	mt19937 generator(3);
+	for (int col = 0; col < cols; col++)
+	{
+		matrix.setElement(0, col, col % 7 + 1);
+		elements[make_pair(0, col)] = col % 7 + 1;
+		matrix.setElement(1, cols - 1 - col, col % 5 + 1);
+		elements[make_pair(1, cols - 1 - col)] = col % 5 + 1;
+		int randomCol = (int)(generator() % cols);
+		matrix.setElement(2, randomCol, col % 3 + 1);
+		elements[make_pair(2, randomCol)] = col % 3 + 1;
+	}
+	CHECK(matrix.getElement(0, cols - 1) == (cols - 1) % 7 + 1);
+	CHECK(matrix.getElement(1, 0) == (cols - 1) % 5 + 1);
+	CHECK(matches(matrix, 3, cols, elements));
+}
+
+// THE BULK CONSTRUCTOR KEEPS THE LAST VALUE OF A POSITION, DROPS ZEROS AND SORTS THE ROWS
+void testBulkConstructor()
+{
+	vector<MatrixEntry> entries;
+	Reference elements;
+	mt19937 generator(4);
+	for (int i = 0; i < 5000; i++)
+	{
+		MatrixEntry entry = {(int)(generator() % 60), (int)(generator() % 70), (int)(generator() % 7) - 3};
+		entries.push_back(entry);
+		if (entry.value == 0)
+		{
+			elements.erase(make_pair(entry.row, entry.col));
+		}
+		else
+		{
+			elements[make_pair(entry.row, entry.col)] = entry.value;
+		}
+	}
+	SparseMatrix matrix(60, 70, entries.data(), entries.size());
+	CHECK(matrix.isFrozen());
+	CHECK(matches(matrix, 60, 70, elements));
+
+	MatrixEntry outside = {60, 0, 1};
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad(60, 70, &outside, 1); }));
+}
+
+// SETTING A VALUE OF 0 REMOVES THE ELEMENT, IN THE ROW TREES AND ON A FROZEN MATRIX
+void testZeroRemovesElement()
+{
+	Reference elements = randomReference(30, 30, 300, 5);
+	SparseMatrix matrix = buildMatrix(30, 30, elements, 6);
+	int removed = 0;
+	for (Reference::iterator element = elements.begin(); element != elements.end();)
+	{
+		if (removed++ % 3 == 0)
+		{
+			matrix.setElement(element->first.first, element->first.second, 0);
+			element = elements.erase(element);
+		}
+		else
+		{
+			++element;
+		}
+	}
+	CHECK(matches(matrix, 30, 30, elements));
+	matrix.freeze();
+	matrix.setElement(elements.begin()->first.first, elements.begin()->first.second, 0);
+	elements.erase(elements.begin());
+	CHECK(matches(matrix, 30, 30, elements));
+
+	// (3015, 3397, -1015) IS SET TO 0 LATER IN THE FILE
+	SparseMatrix sample(cstr(samplePath("easy_sample_01_3.txt")));
+	CHECK(sample.getElement(3015, 3397) == 0);
+}
+
+// A COPY IS INDEPENDENT OF THE MATRIX, AND A MOVED MATRIX IS LEFT EMPTY
+void testCopyAndMove()
+{
+	Reference elements = randomReference(20, 25, 150, 7);
+	SparseMatrix matrix = buildMatrix(20, 25, elements, 8);
+	SparseMatrix copy(matrix);
+	copy.setElement(0, 0, 99);
+	CHECK(matches(matrix, 20, 25, elements));
+	matrix.freeze();
+	SparseMatrix frozenCopy(matrix);
+	CHECK(frozenCopy.isFrozen());
+	CHECK(matches(frozenCopy, 20, 25, elements));
+
+	SparseMatrix moved(move(matrix));
+	CHECK(matches(moved, 20, 25, elements));
+	CHECK(matches(matrix, 0, 0, Reference()));
+	SparseMatrix assigned(1, 1);
+	assigned = move(moved);
+	CHECK(matches(assigned, 20, 25, elements));
+}
+
+// SUMS AND DIFFERENCES OF RANDOM MATRICES, WITH ELEMENTS THAT CANCEL OUT
+void testAdditionAndSubtraction()
+{
+	Reference first = randomReference(80, 60, 1500, 9);
+	Reference second = randomReference(80, 60, 1500, 10);
+	for (Reference::iterator element = first.begin(); element != first.end(); ++element)
+	{
+		if (element->first.first % 4 == 0)
+		{
+			second[element->first] = element->second;
+		}
+	}
+	SparseMatrix matrix1 = buildMatrix(80, 60, first, 11);
+	SparseMatrix matrix2 = buildMatrix(80, 60, second, 12);
+	SparseMatrix sum = matrix1 + matrix2;
+	CHECK(matches(sum, 80, 60, referenceSum(first, second, 1)));
+	SparseMatrix difference = matrix1 - matrix2;
+	CHECK(matches(difference, 80, 60, referenceSum(first, second, -1)));
+
+	SparseMatrix other(80, 61);
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad = matrix1 + other; }));
+}
+
+// SHAPES OF THE PRODUCTS OF THE TESTS: rows x inner TIMES inner x rows, WITH firstSize AND secondSize ELEMENTS.
+// THE LAST ONE HAS A FEW VERY WIDE ROWS, WHICH GO TO THE HASH ACCUMULATOR INSTEAD OF THE DENSE ONE
+const int NUM_PRODUCT_SHAPES = 4;
+const int PRODUCT_SHAPES[NUM_PRODUCT_SHAPES][4] = {{70, 50, 1500, 1500}, {40, 300, 4000, 4000}, {30, 200000, 3000, 3000}, {200000, 3, 20, 60000}};
+
+// PRODUCTS OF RANDOM MATRICES, AND MATRICES THAT CANNOT BE MULTIPLIED
+void testMultiplication()
+{
+	for (int s = 0; s < NUM_PRODUCT_SHAPES; s++)
+	{
+		int rows = PRODUCT_SHAPES[s][0], inner = PRODUCT_SHAPES[s][1];
+		Reference first = randomReference(rows, inner, PRODUCT_SHAPES[s][2], 13 + s);
+		Reference second = randomReference(inner, rows, PRODUCT_SHAPES[s][3], 23 + s);
+		SparseMatrix matrix1 = buildMatrix(rows, inner, first, 33 + s);
+		SparseMatrix matrix2 = buildMatrix(inner, rows, second, 43 + s);
+		SparseMatrix product = matrix1 * matrix2;
+		CHECK(matches(product, rows, rows, referenceProduct(first, second)));
+	}
+
+	SparseMatrix matrix1(3, 4);
+	SparseMatrix matrix2(4, 5);
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad = matrix1 * matrix2; }));
+}
+
+// THE STRUCTURE OF A PRODUCT IS REUSED FOR NEW VALUES WITH THE SAME PATTERNS, AND REJECTED FOR ANOTHER PATTERN
+void testProductStructure()
+{
+	for (int s = 0; s < NUM_PRODUCT_SHAPES; s++)
+	{
+		int rows = PRODUCT_SHAPES[s][0], inner = PRODUCT_SHAPES[s][1];
+		Reference first = randomReference(rows, inner, PRODUCT_SHAPES[s][2], 61 + s);
+		Reference second = randomReference(inner, rows, PRODUCT_SHAPES[s][3], 71 + s);
+		SparseMatrix matrix1 = buildMatrix(rows, inner, first, 81 + s);
+		SparseMatrix matrix2 = buildMatrix(inner, rows, second, 91 + s);
+		ProductStructure structure = matrix1.multiplySymbolic(matrix2);
+
+		for (Reference::iterator element = first.begin(); element != first.end(); ++element)
+		{
+			element->second = element->second * 3 + 1;
+			if (element->second == 0)
+			{
+				element->second = 5;
+			}
+		}
+		SparseMatrix scaled = buildMatrix(rows, inner, first, 101 + s);
+		SparseMatrix product = scaled.multiplyNumeric(matrix2, structure);
+		CHECK(matches(product, rows, rows, referenceProduct(first, second)));
+
+		// AN ELEMENT IN A ROW OF THE FIRST MATRIX THAT HAD NONE GIVES PRODUCTS OUTSIDE THE STRUCTURE
+		for (int row = 0; row < rows; row++)
+		{
+			if (first.lower_bound(make_pair(row, 0)) == first.lower_bound(make_pair(row + 1, 0)))
+			{
+				for (int col = 0; col < inner; col++)
+				{
+					if (second.lower_bound(make_pair(col, 0)) != second.lower_bound(make_pair(col + 1, 0)))
+					{
+						scaled.setElement(row, col, 1);
+						CHECK(throws<invalid_argument>([&]() { SparseMatrix bad = scaled.multiplyNumeric(matrix2, structure); }));
+						break;
+					}
+				}
+				break;
+			}
+		}
+	}
+}
+
+// THE OPERATIONS ON SEVERAL THREADS GIVE THE SAME RESULTS AS ON ONE
+void testThreads()
+{
+	Reference first = randomReference(1000, 800, 40000, 71);
+	Reference second = randomReference(800, 1000, 40000, 72);
+	Reference third = randomReference(1000, 800, 40000, 73);
+	SparseMatrix matrix1 = buildMatrix(1000, 800, first, 74);
+	SparseMatrix matrix2 = buildMatrix(800, 1000, second, 75);
+	SparseMatrix matrix3 = buildMatrix(1000, 800, third, 76);
+	Reference product = referenceProduct(first, second);
+	Reference sum = referenceSum(first, third, 1);
+	Reference difference = referenceSum(first, third, -1);
+	int threads[] = {1, 4, 7};
+	for (int t = 0; t < 3; t++)
+	{
+		SparseMatrix::setNumThreads(threads[t]);
+		SparseMatrix productMatrix = matrix1 * matrix2;
+		CHECK(matches(productMatrix, 1000, 1000, product));
+		SparseMatrix sumMatrix = matrix1 + matrix3;
+		CHECK(matches(sumMatrix, 1000, 800, sum));
+		SparseMatrix differenceMatrix = matrix1 - matrix3;
+		CHECK(matches(differenceMatrix, 1000, 800, difference));
+	}
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix::setNumThreads(0); }));
+	SparseMatrix::setNumThreads(4);
+}
+
+// ONE ROW HOLDS MOST OF THE WORK, SO THE THREADS HAVE TO SHARE THE OTHER ROWS AROUND IT
+void testSkewedRows()
+{
+	Reference first = randomReference(2000, 2000, 20000, 81);
+	for (int col = 0; col < 2000; col++)
+	{
+		first[make_pair(7, col)] = col % 9 + 1;
+	}
+	Reference second = randomReference(2000, 2000, 40000, 82);
+	SparseMatrix matrix1 = buildMatrix(2000, 2000, first, 83);
+	SparseMatrix matrix2 = buildMatrix(2000, 2000, second, 84);
+	SparseMatrix product = matrix1 * matrix2;
+	CHECK(matches(product, 2000, 2000, referenceProduct(first, second)));
+}
+
+// MALFORMED LINES ARE REJECTED WITH invalid_argument, AND A MISSING FILE WITH ios_base::failure
+void testMalformedFiles()
+{
+	const char *malformed[] = {
+		"rows=3\ncols=3\n(0, 1, 2\n",
+		"rows=3\ncols=3\n(0, 1, x)\n",
+		"rows=3\ncols=3\n(3, 1, 2)\n",
+		"rows=3\ncols=3\n(0, 4, 2)\n",
+		"rows=3\ncols=3\n(-1, 1, 2)\n",
+		"rows=3\ncols=3\n(0, 1, 99999999999)\n",
+		"rows=3\n(0, 1, 2)\n",
+		"cols=3\nrows=3\n(0, 1, 2)\n",
+		"rows=3\ncols=3\n(0, 1, 2) (1, 1, 1)\n"};
+	string path = workPath("malformed.txt");
+	for (int m = 0; m < 9; m++)
+	{
+		writeFile(path, malformed[m]);
+		CHECK(throws<invalid_argument>([&]() { SparseMatrix bad(cstr(path)); }));
+	}
+
+	writeFile(path, " rows = 3 \r\ncols=3\r\n\r\n ( 0 ,\t1 , -2 ) \r\n(2, 3, 5)\n(2, 2, +4)\n");
+	SparseMatrix matrix(cstr(path));
+	Reference elements;
+	elements[make_pair(0, 1)] = -2;
+	elements[make_pair(2, 2)] = 4;
+	CHECK(matches(matrix, 3, 3, elements));
+
+	CHECK(throws<ios_base::failure>([&]() { SparseMatrix missing(cstr(workPath("missing.txt"))); }));
+}
+
+// A FILE LARGE ENOUGH TO BE SCANNED IN PIECES AND PRINTED ON SEVERAL THREADS
+void testLargeFile()
+{
+	Reference elements = randomReference(20000, 20000, 300000, 91);
+	string path = workPath("large.txt");
+	writeFile(path, referenceText(20000, 20000, elements));
+	SparseMatrix::setNumThreads(4);
+	SparseMatrix matrix(cstr(path));
+	CHECK(matches(matrix, 20000, 20000, elements));
+	SparseMatrix::setNumThreads(1);
+	SparseMatrix serial(cstr(path));
+	CHECK(matches(serial, 20000, 20000, elements));
+	SparseMatrix::setNumThreads(4);
+}
+
+// WRITES A BINARY FILE WITH THE GIVEN ARRAYS AND A VALID CHECKSUM
+void writeBinaryArrays(const string &path, int rows, int cols, const vector<long> &rowPtr, const vector<int> &colIdx,
+					   const vector<int> &values)
+{
+	BinaryMatrixHeader header;
+	memcpy(header.magic, BINARY_MATRIX_MAGIC, sizeof(header.magic));
+	header.version = BINARY_MATRIX_VERSION;
+	header.headerSize = sizeof(header);
+	header.rows = rows;
+	header.cols = cols;
+	header.nnz = colIdx.size();
+	header.checksum = binaryMatrixChecksum(rowPtr.data(), rows, colIdx.data(), values.data());
+	int fileDescriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	writeAll(fileDescriptor, &header, sizeof(header));
+	writeAll(fileDescriptor, rowPtr.data(), rowPtr.size() * sizeof(long));
+	writeAll(fileDescriptor, colIdx.data(), colIdx.size() * sizeof(int));
+	writeAll(fileDescriptor, values.data(), values.size() * sizeof(int));
+	close(fileDescriptor);
+}
+
+// A BINARY FILE GIVES THE MATRIX BACK, AND A CORRUPTED OR CRAFTED ONE IS REJECTED BEFORE ITS ARRAYS ARE USED
+void testBinaryFormat()
+{
+	string text = samplePath("student/train_02_1.txt");
+	string binary = workPath("binary.smbin");
+	SparseMatrix matrix(cstr(text));
+	matrix.writeBinaryFile(cstr(binary));
+	SparseMatrix opened(cstr(binary));
+	string output = workPath("binary.txt");
+	opened.printToASCIIFile(cstr(output));
+	CHECK(sameFiles(output, text));
+	SparseMatrix sum = opened + matrix;
+	SparseMatrix expected = matrix + matrix;
+	string expectedOutput = workPath("binary_expected.txt");
+	sum.printToASCIIFile(cstr(output));
+	expected.printToASCIIFile(cstr(expectedOutput));
+	CHECK(sameFiles(output, expectedOutput));
+
+	string contents = readFile(binary);
+	string corrupted = workPath("corrupted.smbin");
+	contents[contents.size() - 3] ^= 1;
+	writeFile(corrupted, contents);
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad(cstr(corrupted)); }));
+	writeFile(corrupted, contents.substr(0, contents.size() - 4));
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad(cstr(corrupted)); }));
+
+	vector<int> values(3, 5);
+	string crafted = workPath("crafted.smbin");
+	long goodRows[] = {0, 2, 2, 3};
+	int goodCols[] = {0, 2, 1};
+	writeBinaryArrays(crafted, 3, 3, vector<long>(goodRows, goodRows + 4), vector<int>(goodCols, goodCols + 3), values);
+	SparseMatrix good(cstr(crafted));
+	CHECK(good.getElement(0, 2) == 5 && good.getElement(2, 1) == 5 && good.getElement(1, 1) == 0);
+
+	int outOfRange[] = {0, 2000000000, 1};
+	writeBinaryArrays(crafted, 3, 3, vector<long>(goodRows, goodRows + 4), vector<int>(outOfRange, outOfRange + 3), values);
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad(cstr(crafted)); }));
+	int unsorted[] = {2, 0, 1};
+	writeBinaryArrays(crafted, 3, 3, vector<long>(goodRows, goodRows + 4), vector<int>(unsorted, unsorted + 3), values);
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad(cstr(crafted)); }));
+
+	// THE OFFSET OF ROW 1 POINTS FAR PAST THE END OF colIdx, AND THE LAST ONE STILL MATCHES THE NUMBER OF ELEMENTS
+	long pastEnd[] = {0, 1000000000, 0};
+	writeBinaryArrays(crafted, 2, 3, vector<long>(pastEnd, pastEnd + 3), vector<int>(), vector<int>());
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad(cstr(crafted)); }));
+}
+
+// A CACHED TEXT FILE IS OPENED FROM ITS BINARY COPY UNTIL IT CHANGES, AND A BAD COPY IS IGNORED
+void testFileCache()
+{
+	Reference elements = randomReference(100, 90, 2000, 101);
+	string text = workPath("cached.txt");
+	writeFile(text, referenceText(100, 90, elements));
+	string cacheFile = MatrixFileCache::cachePath(text.c_str());
+	unlink(cacheFile.c_str());
+	MatrixFileCache::setEnabled(true);
+
+	SparseMatrix first(cstr(text));
+	CHECK(matches(first, 100, 90, elements));
+	CHECK(access(cacheFile.c_str(), F_OK) == 0);
+	SparseMatrix cached(cstr(text));
+	CHECK(matches(cached, 100, 90, elements));
+
+	elements[make_pair(99, 89)] = 7;
+	writeFile(text, referenceText(100, 90, elements));
+	SparseMatrix changed(cstr(text));
+	CHECK(matches(changed, 100, 90, elements));
+
+	string contents = readFile(cacheFile);
+	contents[contents.size() - 1] ^= 1;
+	writeFile(cacheFile, contents);
+	SparseMatrix corrupted(cstr(text));
+	CHECK(matches(corrupted, 100, 90, elements));
+
+	MatrixFileCache::setEnabled(false);
+	unlink(cacheFile.c_str());
+}
+
+// MATRIX MARKET FILES ARE READ WITH ROWS AND COLUMNS FROM 1, THEIR SYMMETRIES EXPANDED, AND WRITTEN BACK
+void testMatrixMarket()
+{
+	string path = workPath("matrix.mtx");
+	writeFile(path, "%%MatrixMarket matrix coordinate integer general\n% comment\n3 4 3\n1 1 5\n3 4 -2\n2 3 7\n");
+	SparseMatrix general(cstr(path));
+	Reference elements;
+	elements[make_pair(0, 0)] = 5;
+	elements[make_pair(2, 3)] = -2;
+	elements[make_pair(1, 2)] = 7;
+	CHECK(matches(general, 3, 4, elements));
+
+	string written = workPath("written.mtx");
+	general.writeMatrixMarketFile(cstr(written));
+	SparseMatrix reread(cstr(written));
+	CHECK(matches(reread, 3, 4, elements));
+
+	writeFile(path, "%%MatrixMarket matrix coordinate real symmetric\n3 3 2\n2 1 1.6\n3 3 -4\n");
+	SparseMatrix symmetric(cstr(path));
+	elements.clear();
+	elements[make_pair(1, 0)] = 2;
+	elements[make_pair(0, 1)] = 2;
+	elements[make_pair(2, 2)] = -4;
+	CHECK(matches(symmetric, 3, 3, elements));
+
+	writeFile(path, "%%MatrixMarket matrix coordinate pattern skew-symmetric\n3 3 1\n3 1\n");
+	SparseMatrix skew(cstr(path));
+	elements.clear();
+	elements[make_pair(2, 0)] = 1;
+	elements[make_pair(0, 2)] = -1;
+	CHECK(matches(skew, 3, 3, elements));
+
+	writeFile(path, "%%MatrixMarket matrix coordinate integer general\n3 3 3\n1 1 5\n2 2 5\n");
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad(cstr(path)); }));
+	writeFile(path, "%%MatrixMarket matrix coordinate integer general\n3 3 1\n0 1 5\n");
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix bad(cstr(path)); }));
+}
+
+// ADDING AND SUBTRACTING FILES ROW BY ROW GIVES THE STORED OUTPUTS, AND ROWS OUT OF ORDER ARE REJECTED
+void testStreamedFiles()
+{
+	const char *tests[] = {"01", "02", "03", "04"};
+	string output = workPath("streamed.txt");
+	for (int t = 0; t < 4; t++)
+	{
+		string prefix = samplePath("student/train_") + tests[t];
+		string expected = samplePath("student/output/train_") + tests[t];
+		SparseMatrix::addFiles(cstr(prefix + "_1.txt"), cstr(prefix + "_2.txt"), cstr(output));
+		CHECK(sameFiles(output, expected + "_1_add_2.txt"));
+		SparseMatrix::subtractFiles(cstr(prefix + "_1.txt"), cstr(prefix + "_2.txt"), cstr(output));
+		CHECK(sameFiles(output, expected + "_1_subt_2.txt"));
+	}
+
+	string binary = workPath("streamed.smbin");
+	SparseMatrix matrix(cstr(samplePath("student/train_03_2.txt")));
+	matrix.writeBinaryFile(cstr(binary));
+	SparseMatrix::addFiles(cstr(samplePath("student/train_03_1.txt")), cstr(binary), cstr(output));
+	CHECK(sameFiles(output, samplePath("student/output/train_03_1_add_2.txt")));
+
+	string unordered = workPath("unordered.txt");
+	writeFile(unordered, "rows=3\ncols=3\n(2, 1, 2)\n(0, 1, 2)\n");
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix::addFiles(cstr(unordered), cstr(unordered), cstr(output)); }));
+
+	// THE ROW READER CHECKS THE OFFSETS OF A BINARY FILE AS IT GOES, SINCE IT DOES NOT VERIFY THE CHECKSUM
+	long pastEnd[] = {0, 1000000000, 0};
+	string crafted = workPath("crafted.smbin");
+	writeBinaryArrays(crafted, 2, 3, vector<long>(pastEnd, pastEnd + 3), vector<int>(), vector<int>());
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix::addFiles(cstr(crafted), cstr(crafted), cstr(output)); }));
+}
+
+// MULTIPLYING FILES WITHIN A MEMORY BUDGET GIVES THE STORED OUTPUTS, WITH ONE COLUMN PANEL OR MANY
+void testBudgetedProduct()
+{
+	const char *tests[] = {"01", "02", "03", "04"};
+	long long budgets[] = {1LL << 30, 300000, 100000};
+	string output = workPath("budgeted.txt");
+	for (int t = 0; t < 4; t++)
+	{
+		string prefix = samplePath("student/train_") + tests[t];
+		string expected = samplePath("student/output/train_") + tests[t] + "_1_mul_3.txt";
+		for (int b = 0; b < 3; b++)
+		{
+			SparseMatrix::multiplyFiles(cstr(prefix + "_1.txt"), cstr(prefix + "_3.txt"), cstr(output), budgets[b]);
+			CHECK(sameFiles(output, expected));
+		}
+	}
+	CHECK(throws<invalid_argument>([&]() { SparseMatrix::multiplyFiles(cstr(samplePath("student/train_01_1.txt")),
+																	   cstr(samplePath("student/train_01_2.txt")), cstr(output), 1 << 20); }));
+}
+
+// y = A x AND y = A^T x FOR EVERY TYPE, ON ONE THREAD AND ON SEVERAL
+template <typename T>
+void checkMatrixVector(SparseMatrix &matrix, int rows, int cols, const Reference &elements)
+{
+	vector<T> x(cols), xTransposed(rows);
+	for (int col = 0; col < cols; col++)
+	{
+		x[col] = (T)(col % 11 - 5);
+	}
+	for (int row = 0; row < rows; row++)
+	{
+		xTransposed[row] = (T)(row % 7 - 3);
+	}
+	vector<T> expected(rows, 0), expectedTransposed(cols, 0);
+	for (Reference::const_iterator element = elements.begin(); element != elements.end(); ++element)
+	{
+		expected[element->first.first] += (T)element->second * x[element->first.second];
+		expectedTransposed[element->first.second] += (T)element->second * xTransposed[element->first.first];
+	}
+	vector<T> y, yTransposed;
+	matrix.multiply(x, y);
+	CHECK(y == expected);
+	matrix.multiplyTransposed(xTransposed, yTransposed);
+	CHECK(yTransposed == expectedTransposed);
+	CHECK(throws<invalid_argument>([&]() { matrix.multiply(xTransposed, y); }));
+}
+
+void testMatrixVector()
+{
+	Reference elements = randomReference(3000, 2500, 300000, 111);
+	for (int col = 0; col < 2500; col++)
+	{
+		elements[make_pair(5, col)] = col % 9 + 1;
+	}
+	SparseMatrix matrix = buildMatrix(3000, 2500, elements, 112);
+	int threads[] = {1, 4};
+	for (int t = 0; t < 2; t++)
+	{
+		SparseMatrix::setNumThreads(threads[t]);
+		checkMatrixVector<int>(matrix, 3000, 2500, elements);
+		checkMatrixVector<long>(matrix, 3000, 2500, elements);
+		checkMatrixVector<float>(matrix, 3000, 2500, elements);
+		checkMatrixVector<double>(matrix, 3000, 2500, elements);
+	}
+	SparseMatrix::setNumThreads(4);
+
+	// INTEGER SUMS WRAP AROUND IN EVERY KERNEL
+	SparseMatrix large(1, 40);
+	for (int col = 0; col < 40; col++)
+	{
+		large.setElement(0, col, INT_MAX);
+	}
+	vector<int> ones(40, 1), y;
+	large.multiply(ones, y);
+	CHECK(y[0] == (int)(40u * (unsigned int)INT_MAX));
+}
+
+// Y = A X FOR BLOCKS OF 1 TO 9 VECTORS
+template <typename T>
+void checkMatrixBlock(SparseMatrix &matrix, int rows, int cols, const Reference &elements, int numVectors)
+{
+	vector<T> X((size_t)cols * numVectors);
+	for (size_t i = 0; i < X.size(); i++)
+	{
+		X[i] = (T)((int)(i % 13) - 6);
+	}
+	vector<T> expected((size_t)rows * numVectors, 0);
+	for (Reference::const_iterator element = elements.begin(); element != elements.end(); ++element)
+	{
+		for (int vector = 0; vector < numVectors; vector++)
+		{
+			expected[(size_t)element->first.first * numVectors + vector] +=
+				(T)element->second * X[(size_t)element->first.second * numVectors + vector];
+		}
+	}
+	vector<T> Y;
+	matrix.multiplyBlock(X, numVectors, Y);
+	CHECK(Y == expected);
+}
+
+void testMatrixBlock()
+{
+	Reference elements = randomReference(1500, 1200, 60000, 121);
+	SparseMatrix matrix = buildMatrix(1500, 1200, elements, 122);
+	for (int numVectors = 1; numVectors <= 9; numVectors++)
+	{
+		checkMatrixBlock<int>(matrix, 1500, 1200, elements, numVectors);
+		checkMatrixBlock<long>(matrix, 1500, 1200, elements, numVectors);
+		checkMatrixBlock<float>(matrix, 1500, 1200, elements, numVectors);
+		checkMatrixBlock<double>(matrix, 1500, 1200, elements, numVectors);
+	}
+	vector<int> X(10), Y;
+	CHECK(throws<invalid_argument>([&]() { matrix.multiplyBlock(X, 2, Y); }));
+	CHECK(throws<invalid_argument>([&]() { matrix.multiplyBlock(X, 0, Y); }));
+}
+
+// THE TRANSPOSE OF A SAMPLE AND OF A RANDOM MATRIX, AND TRANSPOSING TWICE GIVES THE MATRIX BACK
+void testTranspose()
+{
+	Reference elements = randomReference(900, 700, 50000, 131);
+	SparseMatrix matrix = buildMatrix(900, 700, elements, 132);
+	Reference transposed;
+	for (Reference::iterator element = elements.begin(); element != elements.end(); ++element)
+	{
+		transposed[make_pair(element->first.second, element->first.first)] = element->second;
+	}
+	SparseMatrix transposedMatrix = matrix.transpose();
+	CHECK(transposedMatrix.isFrozen());
+	CHECK(matches(transposedMatrix, 700, 900, transposed));
+	SparseMatrix back = transposedMatrix.transpose();
+	CHECK(matches(back, 900, 700, elements));
+
+	string text = samplePath("student/train_04_1.txt");
+	SparseMatrix sample(cstr(text));
+	SparseMatrix twice = sample.transpose().transpose();
+	string output = workPath("transposed.txt");
+	twice.printToASCIIFile(cstr(output));
+	CHECK(sameFiles(output, text));
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 3)
+	{
+		printf("Usage: ./SparseMatrixTests pathToSampleInput workDirectory\n");
+		return 2;
+	}
+	sampleDirectory = argv[1];
+	workDirectory = argv[2];
+	LogManager::setLogDirectory(argv[2]);
+	LogManager::resetLogFile();
+
+	testSampleOutputs();
+	testEasySamples();
+	testFreeze();
+	testBalancedRows();
+	testBulkConstructor();
+	testZeroRemovesElement();
+	testCopyAndMove();
+	testAdditionAndSubtraction();
+	testMultiplication();
+	testProductStructure();
+	testThreads();
+	testSkewedRows();
+	testMalformedFiles();
+	testLargeFile();
+	testBinaryFormat();
+	testFileCache();
+	testMatrixMarket();
+	testStreamedFiles();
+	testBudgetedProduct();
+	testMatrixVector();
+	testMatrixBlock();
+	testTranspose();
+
+	printf("%d checks, %d failed\n", numChecks, numFailures);
+	return numFailures == 0 ? 0 : 1;
+}